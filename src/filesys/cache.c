@@ -0,0 +1,433 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache.
+
+   Holds the most recently used sectors of the file system
+   device, so that the file system reads and writes whole or
+   partial sectors through memory instead of going to the disk
+   each time.  Entries are replaced with the clock algorithm.
+
+   Writes only modify the cached copy.  Dirty sectors reach the
+   disk when they are evicted, when the flusher thread wakes up
+   every FLUSH_MSEC milliseconds, and at cache_flush().  The
+   flusher first commits the running journal transaction.  A
+   sector changed by a transaction that has not committed yet is
+   neither written back nor evicted until the journal is done
+   with it (see journal.c).
+
+   Sectors asked for with cache_read_ahead() are read by the
+   prefetcher thread, so that the caller need not wait.
+
+   A single lock protects the whole cache, but it is not held
+   across disk I/O.  Instead the entry is marked busy, which
+   keeps other threads from using or evicting it until the I/O
+   is done. */
+
+/* Number of sectors cached, by default.  Set with -bc. */
+size_t cache_sector_cnt = 64;
+
+/* How often dirty sectors are written back, in milliseconds. */
+#define FLUSH_MSEC 5000
+
+/* Number of sectors that may be waiting to be read ahead. */
+#define READ_AHEAD_CNT 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    struct hash_elem elem;              /* Element in cache_map. */
+    block_sector_t sector;              /* Sector held, if IN_USE. */
+    bool in_use;                        /* Holds a sector? */
+    bool dirty;                         /* Modified since written? */
+    bool accessed;                      /* Used since hand passed? */
+    bool busy;                          /* Disk I/O in progress? */
+    unsigned txn;                       /* Journal transaction holding
+                                           it in the cache, or 0. */
+    uint8_t *data;                      /* Contents of sector. */
+  };
+
+static struct cache_entry *entries;     /* All the entries. */
+static size_t hand;                     /* Clock hand, in ENTRIES. */
+static struct hash cache_map;           /* Entries in use, by sector. */
+static struct lock cache_lock;          /* Protects all of the above. */
+static struct condition io_done;        /* Signaled when I/O ends, or
+                                           the journal lets go. */
+
+/* Sectors waiting to be read ahead, a circular queue, also
+   protected by cache_lock. */
+static block_sector_t read_ahead_queue[READ_AHEAD_CNT];
+static size_t read_ahead_head;          /* Next sector to read. */
+static size_t read_ahead_cnt;           /* Number of sectors queued. */
+static struct condition read_ahead_cond; /* Signaled when queued. */
+
+/* Statistics. */
+static long long hit_cnt;
+static long long miss_cnt;
+static long long read_ahead_done_cnt;
+static long long write_back_cnt;
+
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static struct cache_entry *get_entry (block_sector_t, bool read,
+                                      bool demand);
+static struct cache_entry *lookup (block_sector_t);
+static void write_back (struct cache_entry *);
+static void flusher (void *aux);
+static void prefetcher (void *aux);
+
+/* Sets up the buffer cache and starts its threads. */
+void
+cache_init (void)
+{
+  size_t page_cnt = DIV_ROUND_UP (cache_sector_cnt * BLOCK_SECTOR_SIZE,
+                                  PGSIZE);
+  uint8_t *data;
+  size_t i;
+
+  if (cache_sector_cnt == 0)
+    PANIC ("buffer cache must hold at least one sector");
+  entries = calloc (cache_sector_cnt, sizeof *entries);
+  data = palloc_get_multiple (0, page_cnt);
+  if (entries == NULL || data == NULL)
+    PANIC ("could not allocate %zu-sector buffer cache", cache_sector_cnt);
+  for (i = 0; i < cache_sector_cnt; i++)
+    entries[i].data = data + i * BLOCK_SECTOR_SIZE;
+  hash_init (&cache_map, entry_hash, entry_less, NULL);
+  lock_init (&cache_lock);
+  cond_init (&io_done);
+  cond_init (&read_ahead_cond);
+
+  thread_create ("flusher", PRI_DEFAULT, flusher, NULL);
+  thread_create ("prefetcher", PRI_DEFAULT, prefetcher, NULL);
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at offset OFS within SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, true, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&cache_lock);
+}
+
+/* Writes SECTOR from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at offset
+   OFS.  The rest of the sector keeps its contents. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE, true);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&cache_lock);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at offset
+   OFS, as part of journal transaction TXN.  The sector then stays
+   in the cache, and is not written back, until cache_end_txn()
+   is called for TXN or a later transaction. */
+void
+cache_write_txn (block_sector_t sector, const void *buffer,
+                 size_t ofs, size_t size, unsigned txn)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs + size <= BLOCK_SECTOR_SIZE);
+  ASSERT (txn != 0);
+
+  lock_acquire (&cache_lock);
+  e = get_entry (sector, size < BLOCK_SECTOR_SIZE, true);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  e->txn = txn;
+  lock_release (&cache_lock);
+}
+
+/* Copies SECTOR, which a journal transaction is holding in the
+   cache, into BUFFER. */
+void
+cache_read_txn (block_sector_t sector, void *buffer)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  ASSERT (e != NULL && e->txn != 0 && !e->busy);
+  memcpy (buffer, e->data, BLOCK_SECTOR_SIZE);
+  lock_release (&cache_lock);
+}
+
+/* Releases SECTOR from journal transaction TXN, which has been
+   committed, unless a later transaction has changed it since.
+   If DISK is non-null, it is what the disk now holds for SECTOR,
+   and the sector is clean if it still holds the same. */
+void
+cache_end_txn (block_sector_t sector, unsigned txn, const void *disk)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  if (e != NULL && e->txn == txn)
+    {
+      e->txn = 0;
+      if (disk != NULL && !memcmp (e->data, disk, BLOCK_SECTOR_SIZE))
+        e->dirty = false;
+      cond_broadcast (&io_done, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Asks for SECTOR to be brought into the cache in the
+   background, because it will probably be read soon.  Does
+   nothing if it is already cached or too many sectors are
+   waiting already. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (read_ahead_cnt < READ_AHEAD_CNT && lookup (sector) == NULL)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt++) % READ_AHEAD_CNT;
+      read_ahead_queue[tail] = sector;
+      cond_signal (&read_ahead_cond, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector to disk, except those held by
+   journal transactions. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_sector_cnt; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      if (e->in_use && e->dirty && !e->busy && e->txn == 0)
+        write_back (e);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  long long access_cnt = hit_cnt + miss_cnt;
+
+  printf ("Cache: %lld hits, %lld misses (%lld%% hit rate), "
+          "%lld sectors read ahead, %lld written back\n",
+          hit_cnt, miss_cnt, access_cnt > 0 ? hit_cnt * 100 / access_cnt : 0,
+          read_ahead_done_cnt, write_back_cnt);
+}
+
+/* Returns the entry for SECTOR, bringing it into the cache if
+   necessary, with the cache lock held.  If READ is false, the
+   caller is about to overwrite the whole sector, so it is not
+   read from disk on a miss.  DEMAND is false for read-ahead,
+   which does not count as a hit or a miss. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool read, bool demand)
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (;;)
+    {
+      size_t i;
+
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          if (!e->busy)
+            {
+              if (demand)
+                hit_cnt++;
+              e->accessed = true;
+              return e;
+            }
+          cond_wait (&io_done, &cache_lock);
+          continue;
+        }
+
+      /* Look for a victim with the clock algorithm.  Two sweeps
+         clear every accessed bit, so if nothing is found by
+         then, every entry is busy or held by the journal. */
+      for (i = 0; i < 2 * cache_sector_cnt; i++)
+        {
+          e = &entries[hand];
+          hand = (hand + 1) % cache_sector_cnt;
+          if (!e->in_use)
+            break;
+          else if (e->busy || e->txn != 0)
+            continue;
+          else if (e->accessed)
+            e->accessed = false;
+          else if (e->dirty)
+            {
+              /* Write it back, then start over, because the
+                 cache may have changed while the lock was not
+                 held. */
+              write_back (e);
+              break;
+            }
+          else
+            {
+              hash_delete (&cache_map, &e->elem);
+              e->in_use = false;
+              break;
+            }
+        }
+      if (i == 2 * cache_sector_cnt)
+        cond_wait (&io_done, &cache_lock);
+      else if (!e->in_use)
+        break;
+    }
+
+  if (demand)
+    miss_cnt++;
+  e->sector = sector;
+  e->in_use = true;
+  e->dirty = false;
+  e->accessed = true;
+  e->txn = 0;
+  hash_insert (&cache_map, &e->elem);
+  if (read)
+    {
+      e->busy = true;
+      lock_release (&cache_lock);
+      block_read (fs_device, sector, e->data);
+      lock_acquire (&cache_lock);
+      e->busy = false;
+      cond_broadcast (&io_done, &cache_lock);
+    }
+  return e;
+}
+
+/* Returns the entry that holds SECTOR, or a null pointer if
+   there is none.  The caller must hold the cache lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&cache_map, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Writes E, which must be dirty, back to disk.  The caller must
+   hold the cache lock, which is released during the write. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (e->in_use && e->dirty && !e->busy && e->txn == 0);
+
+  e->busy = true;
+  e->dirty = false;
+  lock_release (&cache_lock);
+  block_write (fs_device, e->sector, e->data);
+  lock_acquire (&cache_lock);
+  e->busy = false;
+  write_back_cnt++;
+  cond_broadcast (&io_done, &cache_lock);
+}
+
+/* Thread that writes dirty sectors back periodically, so that
+   not too much is lost if the machine stops abruptly. */
+static void
+flusher (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (FLUSH_MSEC);
+      journal_commit ();
+      cache_flush ();
+    }
+}
+
+/* Thread that reads the sectors queued by cache_read_ahead(). */
+static void
+prefetcher (void *aux UNUSED)
+{
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      block_sector_t sector;
+
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &cache_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_CNT;
+      read_ahead_cnt--;
+
+      if (lookup (sector) == NULL)
+        {
+          get_entry (sector, true, false);
+          read_ahead_done_cnt++;
+        }
+    }
+}
+
+/* Returns a hash value for the sector held by cache entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *ce = hash_entry (e, struct cache_entry, elem);
+  return hash_int (ce->sector);
+}
+
+/* Returns true if cache entry A holds a lower-numbered sector
+   than cache entry B. */
+static bool
+entry_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct cache_entry, elem)->sector
+          < hash_entry (b, struct cache_entry, elem)->sector);
+}
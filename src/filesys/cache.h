@@ -0,0 +1,23 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors in the buffer cache.  Set with -bc. */
+extern size_t cache_sector_cnt;
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, size_t ofs, size_t size);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_write_txn (block_sector_t, const void *, size_t ofs, size_t size,
+                      unsigned txn);
+void cache_read_txn (block_sector_t, void *);
+void cache_end_txn (block_sector_t, unsigned txn, const void *disk);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
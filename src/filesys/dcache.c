@@ -0,0 +1,258 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* Dentry cache.
+
+   Remembers the results of looking up names in directories, so
+   that resolving a path that was resolved recently needs no
+   directory searches at all.  Each entry maps a directory's
+   inode sector and a name within it either to the sector of the
+   named inode, a positive entry, or to the fact that there is no
+   such name, a negative entry.
+
+   The directory code keeps the cache up to date: adding or
+   removing a name invalidates its entry, and removing a
+   directory purges every entry under it, so that a directory
+   created later in the same sector does not inherit them.
+
+   A lookup that misses searches the directory and then inserts
+   what it found, but the name may have been added or removed in
+   between.  So every invalidation advances a generation number,
+   and an insertion is dropped if the generation has changed
+   since its lookup missed.
+
+   The cache holds at most DCACHE_CNT entries.  When it is full,
+   the least recently used entry is replaced. */
+
+/* Maximum number of entries. */
+#define DCACHE_CNT 512
+
+/* A cached name. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentry_map. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within DIR. */
+    block_sector_t sector;              /* Inode sector, 0 if negative. */
+    bool is_dir;                        /* Is SECTOR a directory? */
+  };
+
+static struct hash dentry_map;          /* All entries, by DIR and NAME. */
+static struct list lru_list;            /* All entries, most recent first. */
+static size_t dentry_cnt;               /* Number of entries. */
+static unsigned generation;             /* Number of invalidations. */
+static struct kmem_cache *dentry_cache; /* Allocates entries. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+/* Statistics. */
+static long long hit_cnt;
+static long long negative_hit_cnt;
+static long long miss_cnt;
+static long long purge_cnt;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry *find (block_sector_t dir, const char *name);
+static void discard (struct dentry *);
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void)
+{
+  hash_init (&dentry_map, dentry_hash, dentry_less, NULL);
+  list_init (&lru_list);
+  dentry_cache = kmem_cache_create ("dentry", sizeof (struct dentry), NULL);
+  lock_init (&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   Returns DCACHE_HIT and sets *SECTORP and *IS_DIRP to the
+   sector of the named inode and whether it is a directory if
+   NAME is known to exist, DCACHE_NEGATIVE if it is known not
+   to, and DCACHE_MISS if nothing is known.  On a miss, also
+   sets *GENP to the generation to pass to dcache_insert(). */
+enum dcache_result
+dcache_lookup (block_sector_t dir, const char *name,
+               block_sector_t *sectorp, bool *is_dirp, unsigned *genp)
+{
+  enum dcache_result result = DCACHE_MISS;
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      *genp = generation;
+      miss_cnt++;
+    }
+  else
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      if (d->sector != 0)
+        {
+          *sectorp = d->sector;
+          *is_dirp = d->is_dir;
+          result = DCACHE_HIT;
+          hit_cnt++;
+        }
+      else
+        {
+          result = DCACHE_NEGATIVE;
+          negative_hit_cnt++;
+        }
+    }
+  lock_release (&dcache_lock);
+  return result;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in SECTOR, which is a directory if
+   IS_DIR is true, or that there is no such name if SECTOR is
+   0.  GEN must be the generation from the dcache_lookup() that
+   missed before the directory was searched.  Does nothing if
+   anything has been invalidated since. */
+void
+dcache_insert (block_sector_t dir, const char *name,
+               block_sector_t sector, bool is_dir, unsigned gen)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  if (gen != generation)
+    {
+      lock_release (&dcache_lock);
+      return;
+    }
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      if (dentry_cnt < DCACHE_CNT)
+        d = kmem_cache_alloc (dentry_cache);
+      if (d != NULL)
+        dentry_cnt++;
+      else if (!list_empty (&lru_list))
+        {
+          /* Reuse the least recently used entry. */
+          d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+          hash_delete (&dentry_map, &d->hash_elem);
+          list_remove (&d->lru_elem);
+        }
+      if (d != NULL)
+        {
+          d->dir = dir;
+          strlcpy (d->name, name, sizeof d->name);
+          hash_insert (&dentry_map, &d->hash_elem);
+          list_push_front (&lru_list, &d->lru_elem);
+        }
+    }
+  if (d != NULL)
+    {
+      d->sector = sector;
+      d->is_dir = is_dir;
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets whatever is known about NAME in the directory whose
+   inode is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    discard (d);
+  generation++;
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name in the directory whose inode is in sector
+   DIR. */
+void
+dcache_purge (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dcache_lock);
+  for (e = list_begin (&lru_list); e != list_end (&lru_list); e = next)
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+      next = list_next (e);
+      if (d->dir == dir)
+        discard (d);
+    }
+  purge_cnt++;
+  generation++;
+  lock_release (&dcache_lock);
+}
+
+/* Prints dentry cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dentry cache: %lld hits, %lld negative hits, %lld misses, "
+          "%lld purges, %zu entries\n",
+          hit_cnt, negative_hit_cnt, miss_cnt, purge_cnt, dentry_cnt);
+}
+
+/* Returns the entry for NAME in DIR, or a null pointer if there
+   is none.  The caller must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_map, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and frees it.  The caller must hold
+   dcache_lock. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentry_map, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  kmem_cache_free (dentry_cache, d);
+  dentry_cnt--;
+}
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
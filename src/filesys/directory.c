@@ -1,16 +1,60 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
-/* A directory. */
+/* A directory.
+
+   A directory is a hash table of entries keyed by name, stored
+   in the directory's file as an array of buckets, one sector
+   each.  The number of buckets is a power of two, and a name's
+   home bucket is given by the low bits of its hash.  When a
+   bucket fills up, entries whose home it is go in the next
+   bucket with room instead, and the full buckets passed over
+   are marked as overflowed, so that a search continues past
+   them.  The directory doubles its number of buckets when it
+   becomes 3/4 full, which keeps nearly every entry in its home
+   bucket, so that a search or an insertion usually reads a
+   single sector.
+
+   Moving every entry at once when the directory doubles would
+   make one operation change every bucket, more than a journal
+   transaction can hold, so entries are moved a bucket at a time
+   instead, one bucket each time an entry is added, until all of
+   the old buckets have been done.  Until then, a name is looked
+   for first from its home bucket among all the buckets, where it
+   is added, and if not there, from its home bucket among the old
+   half of them, where it may not yet have been moved from.
+   Overflow marks are never cleared, which now and then costs a
+   search a sector more than it needs.
+
+   Reading a directory with dir_readdir() still just goes
+   through the entries in order, skipping the free ones.
+
+   Every directory has an entry named "..", which refers to its
+   parent, or to itself for the root.  It counts as an entry, so
+   that an empty directory has one, but dir_readdir() does not
+   return it.
+
+   Each operation on a directory holds the lock of its inode
+   throughout, so that operations on one directory do not see
+   each other half done, while those on different directories
+   run in parallel.  Removing a directory also holds the lock of
+   the directory being removed, taken after its parent's.  Each
+   operation that changes a directory is one journal operation,
+   begun before the lock is taken. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+    off_t pos;                          /* Current position, in entries. */
   };
 
 /* A single directory entry. */
@@ -21,12 +65,97 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Size and number of entries in the directory, kept in its first
+   bucket. */
+struct dir_header
+  {
+    uint32_t bucket_cnt;                /* Number of buckets. */
+    uint32_t entry_cnt;                 /* Number of entries in use. */
+    uint32_t rehash_cnt;                /* Old buckets moved, if growing. */
+  };
+
+/* Number of entries in a bucket. */
+#define BUCKET_ENTRY_CNT ((BLOCK_SECTOR_SIZE - sizeof (uint32_t)          \
+                           - sizeof (struct dir_header))                  \
+                          / sizeof (struct dir_entry))
+
+/* A bucket.  Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct dir_bucket
+  {
+    struct dir_entry entries[BUCKET_ENTRY_CNT];
+    uint32_t overflow;                  /* Search continues past here? */
+    uint8_t unused[BLOCK_SECTOR_SIZE    /* Not used. */
+                   - BUCKET_ENTRY_CNT * sizeof (struct dir_entry)
+                   - sizeof (uint32_t) - sizeof (struct dir_header)];
+    struct dir_header header;           /* Used in bucket 0 only. */
+  };
+
+/* Cache of struct dir. */
+static struct kmem_cache *dir_cache;
+
+static off_t entry_ofs (size_t bucket, size_t slot);
+static size_t home_bucket (const char *name, size_t bucket_cnt);
+static bool write_at (struct dir *, const void *, off_t size, off_t ofs);
+static bool read_header (const struct dir *, struct dir_header *);
+static bool write_header (struct dir *, const struct dir_header *);
+
+/* Initializes the directory module. */
+void
+dir_init (void)
+{
+  /* If this assertion fails, the bucket structure is not exactly
+     one sector in size, and you should fix that. */
+  ASSERT (sizeof (struct dir_bucket) == BLOCK_SECTOR_SIZE);
+
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), NULL);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, whose parent directory's inode is in sector
+   PARENT.  Returns true if successful, false on failure.  Like
+   inode_create(), leaves SECTOR itself to the caller to free on
+   failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header header;
+  struct dir_entry e;
+  struct dir *dir;
+  bool success;
+
+  header.bucket_cnt = 1;
+  while (header.bucket_cnt * BUCKET_ENTRY_CNT * 3 < (entry_cnt + 1) * 4)
+    header.bucket_cnt *= 2;
+  header.entry_cnt = 1;
+  header.rehash_cnt = header.bucket_cnt / 2;
+  journal_begin ();
+  if (!inode_create (sector, header.bucket_cnt * BLOCK_SECTOR_SIZE, true))
+    {
+      journal_end ();
+      return false;
+    }
+
+  /* A directory that used to be in SECTOR may have left names
+     behind. */
+  dcache_purge (sector);
+
+  /* If this fails, the inode's data sectors are lost, because
+     removing the inode would free SECTOR as well. */
+  dir = dir_open (inode_open (sector));
+  if (dir == NULL)
+    {
+      journal_end ();
+      return false;
+    }
+  e.in_use = true;
+  strlcpy (e.name, "..", sizeof e.name);
+  e.inode_sector = parent;
+  success = (write_at (dir, &e, sizeof e,
+                       entry_ofs (home_bucket (e.name, header.bucket_cnt), 0))
+             && write_header (dir, &header));
+  dir_close (dir);
+  journal_end ();
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -34,7 +163,7 @@ dir_create (block_sector_t sector, size_t entry_cnt)
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
+  struct dir *dir = kmem_cache_alloc (dir_cache);
   if (inode != NULL && dir != NULL)
     {
       dir->inode = inode;
@@ -44,7 +173,7 @@ dir_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +201,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -83,34 +212,254 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Returns the byte offset in a directory of the entry in slot
+   SLOT of bucket BUCKET. */
+static off_t
+entry_ofs (size_t bucket, size_t slot)
+{
+  return bucket * BLOCK_SECTOR_SIZE + slot * sizeof (struct dir_entry);
+}
+
+/* Returns the byte offset in a directory of the overflow mark of
+   bucket BUCKET. */
+static off_t
+overflow_ofs (size_t bucket)
+{
+  return bucket * BLOCK_SECTOR_SIZE + offsetof (struct dir_bucket, overflow);
+}
+
+/* Returns the home bucket for NAME in a directory with
+   BUCKET_CNT buckets. */
+static size_t
+home_bucket (const char *name, size_t bucket_cnt)
+{
+  return hash_string (name) & (bucket_cnt - 1);
+}
+
+/* Writes SIZE bytes from BUFFER into DIR at offset OFS.
+   Returns true if successful, false on failure. */
+static bool
+write_at (struct dir *dir, const void *buffer, off_t size, off_t ofs)
+{
+  return inode_write_at (dir->inode, buffer, size, ofs) == size;
+}
+
+/* Reads bucket IDX of DIR into B.  Returns true if successful,
+   false on failure. */
+static bool
+read_bucket (const struct dir *dir, size_t idx, struct dir_bucket *b)
+{
+  return (inode_read_at (dir->inode, b, sizeof *b, idx * BLOCK_SECTOR_SIZE)
+          == sizeof *b);
+}
+
+/* Reads DIR's header into *HEADER.  Returns true if successful,
+   false on failure. */
+static bool
+read_header (const struct dir *dir, struct dir_header *header)
+{
+  return (inode_read_at (dir->inode, header, sizeof *header,
+                         offsetof (struct dir_bucket, header))
+          == sizeof *header);
+}
+
+/* Writes HEADER as DIR's header.  Returns true if successful,
+   false on failure. */
+static bool
+write_header (struct dir *dir, const struct dir_header *header)
+{
+  return write_at (dir, header, sizeof *header,
+                   offsetof (struct dir_bucket, header));
+}
+
+/* Returns true if DIR, whose header is *HEADER, is part way
+   through doubling its number of buckets, false otherwise. */
+static bool
+is_growing (const struct dir_header *header)
+{
+  return header->rehash_cnt < header->bucket_cnt / 2;
+}
+
+/* Searches the first BUCKET_CNT buckets of DIR for a file with
+   the given NAME, starting from its home bucket among them, and
+   reading buckets into B.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   Otherwise, returns false and, if FREE_OFSP is non-null, sets
+   *FREE_OFSP to the byte offset of the first free slot passed
+   during the search, or to -1 if there was none.  An entry for
+   NAME may be stored in that slot as is. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+search (const struct dir *dir, size_t bucket_cnt, const char *name,
+        struct dir_bucket *b, struct dir_entry *ep, off_t *ofsp,
+        off_t *free_ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  size_t idx = home_bucket (name, bucket_cnt);
+  off_t free_ofs = -1;
+  size_t i, j;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  for (i = 0; i < bucket_cnt && read_bucket (dir, idx, b); i++)
+    {
+      for (j = 0; j < BUCKET_ENTRY_CNT; j++)
+        {
+          struct dir_entry *e = &b->entries[j];
+          if (e->in_use && !strcmp (name, e->name)) 
+            {
+              if (ep != NULL)
+                *ep = *e;
+              if (ofsp != NULL)
+                *ofsp = entry_ofs (idx, j);
+              return true;
+            }
+          else if (!e->in_use && free_ofs < 0)
+            free_ofs = entry_ofs (idx, j);
+        }
+      if (!b->overflow)
+        break;
+      idx = (idx + 1) & (bucket_cnt - 1);
+    }
+  if (free_ofsp != NULL)
+    *free_ofsp = free_ofs;
+  return false;
+}
+
+/* Searches DIR, whose header is *HEADER, for a file with the
+   given NAME, reading buckets into B.  Returns and sets *EP,
+   *OFSP and *FREE_OFSP like search().  While DIR is growing, a
+   free slot is only returned among all of its buckets, which is
+   where new entries go. */
+static bool
+lookup (const struct dir *dir, const struct dir_header *header,
+        const char *name, struct dir_bucket *b, struct dir_entry *ep,
+        off_t *ofsp, off_t *free_ofsp)
+{
+  return (search (dir, header->bucket_cnt, name, b, ep, ofsp, free_ofsp)
+          || (is_growing (header)
+              && search (dir, header->bucket_cnt / 2, name, b, ep, ofsp,
+                         NULL)));
+}
+
+/* Stores E in DIR, which has BUCKET_CNT buckets, in the first
+   free slot at or after the home bucket of E's name, reading
+   buckets into B.  Marks the full buckets passed over as
+   overflowed.  Returns true if successful, false if DIR is full
+   or on failure. */
+static bool
+insert (struct dir *dir, size_t bucket_cnt, const struct dir_entry *e,
+        struct dir_bucket *b)
+{
+  static const uint32_t overflow = 1;
+  size_t idx = home_bucket (e->name, bucket_cnt);
+  size_t i, j;
+
+  for (i = 0; i < bucket_cnt && read_bucket (dir, idx, b); i++)
+    {
+      for (j = 0; j < BUCKET_ENTRY_CNT; j++)
+        if (!b->entries[j].in_use)
+          return write_at (dir, e, sizeof *e, entry_ofs (idx, j));
+      if (!b->overflow
+          && !write_at (dir, &overflow, sizeof overflow, overflow_ofs (idx)))
+        return false;
+      idx = (idx + 1) & (bucket_cnt - 1);
+    }
   return false;
 }
 
+/* Doubles the number of buckets in DIR, whose header is
+   *HEADER, and starts moving entries into them (see
+   rehash_next()).  The new buckets take no space until something
+   is written into them.  Returns true if successful.  On failure,
+   returns false and leaves DIR as it was. */
+static bool
+grow (struct dir *dir, struct dir_header *header)
+{
+  static const uint32_t no_overflow = 0;
+  struct dir_header new_header;
+
+  /* Extend the file by writing the last new bucket's overflow
+     mark.  Reading the buckets before it then yields zeros. */
+  new_header.bucket_cnt = header->bucket_cnt * 2;
+  new_header.entry_cnt = header->entry_cnt;
+  new_header.rehash_cnt = 0;
+  if (!write_at (dir, &no_overflow, sizeof no_overflow,
+                 overflow_ofs (new_header.bucket_cnt - 1))
+      || !write_header (dir, &new_header))
+    return false;
+  *header = new_header;
+  return true;
+}
+
+/* Moves the entries in the next old bucket of DIR, which is
+   growing and whose header is *HEADER, that are not in their
+   home bucket among all of DIR's buckets, by taking each one out
+   and adding it again there.  An entry may land in an old bucket
+   not yet visited, and be moved again from there, which does no
+   harm.  Reads buckets into B and SCRATCH.  If an entry cannot be
+   added again, puts it back and leaves the bucket to be done
+   later. */
+static void
+rehash_next (struct dir *dir, struct dir_header *header,
+             struct dir_bucket *b, struct dir_bucket *scratch)
+{
+  size_t idx = header->rehash_cnt;
+  size_t j;
+
+  if (!read_bucket (dir, idx, b))
+    return;
+  for (j = 0; j < BUCKET_ENTRY_CNT; j++)
+    {
+      struct dir_entry *e = &b->entries[j];
+      if (e->in_use && home_bucket (e->name, header->bucket_cnt) != idx)
+        {
+          off_t ofs = entry_ofs (idx, j);
+          e->in_use = false;
+          if (!write_at (dir, e, sizeof *e, ofs))
+            return;
+          e->in_use = true;
+          if (!insert (dir, header->bucket_cnt, e, scratch))
+            {
+              write_at (dir, e, sizeof *e, ofs);
+              return;
+            }
+        }
+    }
+  header->rehash_cnt++;
+  write_header (dir, header);
+}
+
+/* Searches DIR for a file with the given NAME.  On success,
+   returns true and sets *SECTORP to the sector that holds the
+   file's inode, or to 0 if there is no file with that NAME.
+   Returns false if the search fails because memory runs out or
+   the directory cannot be read. */
+bool
+dir_search (const struct dir *dir, const char *name, block_sector_t *sectorp)
+{
+  struct dir_header header;
+  struct dir_bucket *b;
+  struct dir_entry e;
+  bool success = false;
+
+  ASSERT (dir != NULL);
+  ASSERT (name != NULL);
+
+  b = malloc (sizeof *b);
+  inode_lock (dir->inode);
+  if (b != NULL && read_header (dir, &header))
+    {
+      *sectorp = (lookup (dir, &header, name, b, &e, NULL, NULL)
+                  ? e.inode_sector : 0);
+      success = true;
+    }
+  inode_unlock (dir->inode);
+  free (b);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -119,13 +468,10 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
-
-  ASSERT (dir != NULL);
-  ASSERT (name != NULL);
+  block_sector_t sector;
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  if (dir_search (dir, name, &sector) && sector != 0)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -136,11 +482,13 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long, "." or ".."), if DIR
+   has been removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header header;
+  struct dir_bucket *b;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -149,51 +497,99 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX
+      || !strcmp (name, ".") || !strcmp (name, ".."))
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Room for two buckets. */
+  b = malloc (2 * sizeof *b);
+  if (b == NULL)
+    return false;
+  journal_begin ();
+  inode_lock (dir->inode);
+
+  /* Nothing can be added to a removed directory. */
+  if (inode_is_removed (dir->inode) || !read_header (dir, &header))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Check that NAME is not in use, and find where it would go. */
+  if (lookup (dir, &header, name, b, NULL, NULL, &ofs))
+    goto done;
+
+  /* Make room if the directory is getting full, or move along
+     entries if it is growing already.  Either one may fill or
+     free the slot that was found, so it must be found again. */
+  if (is_growing (&header))
+    {
+      rehash_next (dir, &header, b, b + 1);
+      ofs = -1;
+    }
+  else if ((header.entry_cnt + 1) * 4
+           > header.bucket_cnt * BUCKET_ENTRY_CNT * 3
+           && grow (dir, &header))
+    ofs = -1;
 
   /* Write slot. */
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (ofs >= 0)
+    success = write_at (dir, &e, sizeof e, ofs);
+  else
+    success = insert (dir, header.bucket_cnt, &e, b);
+  if (success)
+    {
+      header.entry_cnt++;
+      success = write_header (dir, &header);
+      dcache_invalidate (inode_get_inumber (dir->inode), name);
+    }
 
  done:
+  inode_unlock (dir->inode);
+  journal_end ();
+  free (b);
   return success;
 }
 
+/* Returns true if DIR holds no entries but "..", false
+   otherwise. */
+static bool
+is_empty (const struct dir *dir)
+{
+  struct dir_header header;
+
+  return read_header (dir, &header) && header.entry_cnt <= 1;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME, if NAME
+   is "." or "..", or if it is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_header header;
+  struct dir_bucket *b;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool is_dir = false;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  b = malloc (sizeof *b);
+  if (b == NULL)
+    return false;
+  journal_begin ();
+  inode_lock (dir->inode);
+  if (!read_header (dir, &header)
+      || !lookup (dir, &header, name, b, &e, &ofs, NULL))
     goto done;
 
   /* Open inode. */
@@ -201,36 +597,92 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only an empty directory may be removed.  Holding its lock
+     keeps anything from being added to it until it is marked
+     removed. */
+  is_dir = inode_is_dir (inode);
+  if (is_dir)
+    {
+      struct dir *victim = dir_open (inode_reopen (inode));
+      bool empty;
+
+      inode_lock (inode);
+      empty = victim != NULL && is_empty (victim);
+      dir_close (victim);
+      if (!empty)
+        {
+          inode_unlock (inode);
+          goto done;
+        }
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
-    goto done;
+  success = write_at (dir, &e, sizeof e, ofs);
+  if (success)
+    {
+      header.entry_cnt--;
+      write_header (dir, &header);
+      dcache_invalidate (inode_get_inumber (dir->inode), name);
+      if (is_dir)
+        dcache_purge (e.inode_sector);
 
-  /* Remove inode. */
-  inode_remove (inode);
-  success = true;
+      /* Remove inode. */
+      inode_remove (inode);
+    }
+  if (is_dir)
+    inode_unlock (inode);
 
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
+  journal_end ();
+  free (b);
   return success;
 }
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/* Reads the next directory entry in DIR, other than "..", and
+   stores the name in NAME.  Returns true if successful, false if
+   the directory contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header header;
   struct dir_entry e;
+  bool success = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
-  return false;
+  inode_lock (dir->inode);
+  if (read_header (dir, &header))
+    while (dir->pos < (off_t) (header.bucket_cnt * BUCKET_ENTRY_CNT))
+      {
+        off_t ofs = entry_ofs (dir->pos / BUCKET_ENTRY_CNT,
+                               dir->pos % BUCKET_ENTRY_CNT);
+        if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+          break;
+        dir->pos++;
+        if (e.in_use && strcmp (e.name, ".."))
+          {
+            strlcpy (name, e.name, NAME_MAX + 1);
+            success = true;
+            break;
+          } 
+      }
+  inode_unlock (dir->inode);
+  return success;
+}
+
+/* Sets DIR's position, as used by dir_readdir(), to POS, which
+   must have been returned by dir_tell(), or 0. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns DIR's position, as used by dir_readdir(). */
+off_t
+dir_tell (const struct dir *dir)
+{
+  return dir->pos;
 }
@@ -2,15 +2,24 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static bool resolve (const char *path, block_sector_t *dirp,
+                     char name[NAME_MAX + 1]);
+static bool lookup_name (block_sector_t dir, const char *name,
+                         block_sector_t *sectorp, bool *is_dirp);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +30,12 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  journal_init (format);
   inode_init ();
+  file_init ();
+  dir_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -31,72 +45,320 @@ filesys_init (bool format)
 }
 
 /* Shuts down the file system module, writing any unwritten data
-   to disk. */
+   to disk.  Nothing can be written after a kernel panic, which
+   leaves interrupts off, because the disk driver needs them. */
 void
 filesys_done (void) 
 {
   free_map_close ();
+  if (intr_get_level () == INTR_ON)
+    {
+      journal_done ();
+      cache_flush ();
+    }
 }
 
-/* Creates a file named NAME with the given INITIAL_SIZE.
+/* Creates a file or, if IS_DIR, a directory at PATH, with the
+   given INITIAL_SIZE.
    Returns true if successful, false otherwise.
-   Fails if a file named NAME already exists,
-   or if internal memory allocation fails. */
-bool
-filesys_create (const char *name, off_t initial_size) 
+   Fails if something named PATH already exists, if a directory
+   along the way does not exist, or if internal memory allocation
+   fails. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir)
 {
+  char name[NAME_MAX + 1];
+  block_sector_t parent;
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+  struct dir *dir;
+  bool success = false;
+
+  if (!resolve (path, &parent, name))
+    return false;
+  dir = dir_open (inode_open (parent));
+  if (dir == NULL)
+    return false;
+
+  /* Creating the file and adding it to DIR are one operation, so
+     that a crash cannot leave either without the other. */
+  journal_begin ();
+  if (free_map_allocate (1, parent, &inode_sector))
+    {
+      bool created = (is_dir
+                      ? dir_create (inode_sector, parent, 0)
+                      : inode_create (inode_sector, initial_size, false));
+      success = created && dir_add (dir, name, inode_sector);
+      if (!success)
+        {
+          /* Removing the new inode frees its data as well as its
+             own sector. */
+          struct inode *inode = created ? inode_open (inode_sector) : NULL;
+          if (inode != NULL)
+            {
+              inode_remove (inode);
+              inode_close (inode);
+            }
+          else
+            free_map_release (inode_sector, 1);
+        }
+    }
+  journal_end ();
   dir_close (dir);
 
   return success;
 }
 
-/* Opens the file with the given NAME.
+/* Creates a file at PATH with the given INITIAL_SIZE.
+   Returns true if successful, false otherwise.
+   Fails if something named PATH already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_create (const char *path, off_t initial_size) 
+{
+  return create (path, initial_size, false);
+}
+
+/* Creates an empty directory at PATH.
+   Returns true if successful, false otherwise.
+   Fails if something named PATH already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *path) 
+{
+  return create (path, 0, true);
+}
+
+/* Opens the file or directory at PATH.
    Returns the new file if successful or a null pointer
    otherwise.
-   Fails if no file named NAME exists,
+   Fails if nothing named PATH exists,
    or if an internal memory allocation fails. */
 struct file *
-filesys_open (const char *name)
+filesys_open (const char *path)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
-
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+  char name[NAME_MAX + 1];
+  block_sector_t parent, sector;
+  bool is_dir;
 
-  return file_open (inode);
+  if (!resolve (path, &parent, name)
+      || !lookup_name (parent, name, &sector, &is_dir))
+    return NULL;
+  return file_open (inode_open (sector));
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory at PATH.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if nothing named PATH exists, if PATH is a directory
+   that is not empty, or if an internal memory allocation
+   fails. */
 bool
-filesys_remove (const char *name) 
+filesys_remove (const char *path) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char name[NAME_MAX + 1];
+  block_sector_t parent;
+  struct dir *dir;
+  bool success;
+
+  if (!resolve (path, &parent, name))
+    return false;
+  dir = dir_open (inode_open (parent));
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Makes the directory at PATH the running thread's current
+   directory.
+   Returns true if successful, false on failure.
+   Fails if PATH does not exist or is not a directory. */
+bool
+filesys_chdir (const char *path)
+{
+  char name[NAME_MAX + 1];
+  block_sector_t parent, sector;
+  bool is_dir;
+  struct dir *dir;
+  struct thread *t = thread_current ();
+
+  if (!resolve (path, &parent, name)
+      || !lookup_name (parent, name, &sector, &is_dir)
+      || !is_dir)
+    return false;
+  dir = dir_open (inode_open (sector));
+  if (dir == NULL)
+    return false;
+
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Returns the sector of the directory that PATH starts from: the
+   root directory if PATH is absolute or the running thread has no
+   current directory, otherwise the current directory.  Returns 0
+   if the current directory has been removed, because nothing can
+   be found in it any more. */
+static block_sector_t
+start_dir (const char *path)
+{
+  struct dir *cwd = thread_current ()->cwd;
+
+  if (*path == '/' || cwd == NULL)
+    return ROOT_DIR_SECTOR;
+  else if (inode_is_removed (dir_get_inode (cwd)))
+    return 0;
+  else
+    return inode_get_inumber (dir_get_inode (cwd));
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If found, returns true and stores the sector of its inode in
+   *SECTORP and whether it is a directory in *IS_DIRP.
+   Otherwise, returns false.
+
+   The answer comes from the dentry cache if it is there.  If
+   not, it is found on disk and added to the cache, whether or not
+   NAME exists. */
+static bool
+lookup_name (block_sector_t dir, const char *name,
+             block_sector_t *sectorp, bool *is_dirp)
+{
+  struct dir *d;
+  struct inode *inode;
+  block_sector_t sector;
+  unsigned gen;
+
+  if (!strcmp (name, "."))
+    {
+      *sectorp = dir;
+      *is_dirp = true;
+      return true;
+    }
+
+  switch (dcache_lookup (dir, name, sectorp, is_dirp, &gen))
+    {
+    case DCACHE_HIT:
+      return true;
+    case DCACHE_NEGATIVE:
+      return false;
+    case DCACHE_MISS:
+      break;
+    }
+
+  /* Nothing is cached for a removed directory, which was empty
+     and cannot gain entries, or after an error. */
+  d = dir_open (inode_open (dir));
+  if (d == NULL)
+    return false;
+  if (!inode_is_dir (dir_get_inode (d))
+      || inode_is_removed (dir_get_inode (d))
+      || !dir_search (d, name, &sector))
+    {
+      dir_close (d);
+      return false;
+    }
+  if (sector == 0)
+    {
+      dcache_insert (dir, name, 0, false, gen);
+      dir_close (d);
+      return false;
+    }
+
+  inode = inode_open (sector);
+  if (inode == NULL)
+    {
+      dir_close (d);
+      return false;
+    }
+  *sectorp = sector;
+  *is_dirp = inode_is_dir (inode);
+  inode_close (inode);
+  dcache_insert (dir, name, sector, *is_dirp, gen);
+  dir_close (d);
+  return true;
+}
+
+/* Resolves PATH as far as its last component.  On success,
+   returns true, stores the sector of the directory that the last
+   component lies in into *DIRP, and copies the last component
+   into NAME.  NAME is "." if PATH has no components, as for "/".
+   Returns false if PATH is empty, if a name is too long, or if a
+   directory along the way does not exist. */
+static bool
+resolve (const char *path, block_sector_t *dirp, char name[NAME_MAX + 1])
+{
+  block_sector_t dir = start_dir (path);
+  char next[NAME_MAX + 1];
+  bool is_dir;
+  int result;
+
+  if (*path == '\0' || dir == 0)
+    return false;
+
+  result = get_next_part (name, &path);
+  if (result < 0)
+    return false;
+  else if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  else
+    for (;;)
+      {
+        result = get_next_part (next, &path);
+        if (result < 0)
+          return false;
+        else if (result == 0)
+          break;
+
+        if (!lookup_name (dir, name, &dir, &is_dir) || !is_dir)
+          return false;
+        strlcpy (name, next, NAME_MAX + 1);
+      }
+
+  *dirp = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
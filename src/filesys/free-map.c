@@ -1,85 +1,464 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <list.h>
+#include <stdio.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+
+/* The free map records which sectors are in use, one bit per
+   sector, and is stored on disk in the free map file.
+
+   Allocation does not search the bitmap.  It uses a list of the
+   free extents, runs of consecutive free sectors, in order of
+   sector number.  A request is placed at its goal sector if
+   there is room there, and otherwise at the start of the first
+   large enough extent after the goal, so that a file's sectors
+   end up near each other and near its inode.  A request without
+   a goal continues from the extent where the last allocation was
+   made (next fit).
+
+   Each change to the bitmap is written to the free map file
+   right away, as part of the journal transaction that makes it,
+   so that it reaches the disk together with the inodes and
+   directories that use or stop using the sectors.  Sectors that
+   are released stay out of the free extents, pending, until the
+   transaction that released them has committed.  Otherwise they
+   could be given to a file and written before a crash undid the
+   release. */
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* A run of free sectors. */
+struct extent
+  {
+    struct list_elem elem;           /* Element in extent_list. */
+    block_sector_t start;            /* First sector. */
+    block_sector_t cnt;              /* Number of sectors. */
+    unsigned txn;                    /* If pending, transaction
+                                        that released it. */
+  };
+
+static struct list extent_list;      /* Free extents, by sector. */
+static struct list pending_list;     /* Pending extents. */
+static struct list_elem *cursor;     /* Where next fit resumes. */
+static struct kmem_cache *extent_cache;
+
+/* Protects all of the above. */
+static struct lock free_map_lock;
+
+/* Statistics. */
+static long long alloc_cnt;
+static long long release_cnt;
+static long long write_cnt;
+
+static void build_extents (void);
+static bool allocate (size_t cnt, block_sector_t goal,
+                      block_sector_t *sectorp);
+static void add_extent (struct extent *);
+static void reclaim_pending (void);
+static struct list_elem *extent_after (block_sector_t);
+static bool take_sectors (struct extent *, block_sector_t start,
+                          size_t cnt);
+static void write_bits (block_sector_t, size_t cnt);
+
+/* Returns the sector just past the end of extent E. */
+static inline block_sector_t
+extent_end (const struct extent *e)
+{
+  return e->start + e->cnt;
+}
+
 /* Initializes the free map. */
 void
-free_map_init (void) 
+free_map_init (void)
 {
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTOR_CNT, true);
+
+  list_init (&extent_list);
+  list_init (&pending_list);
+  extent_cache = kmem_cache_create ("extent", sizeof (struct extent), NULL);
+  lock_init (&free_map_lock);
+  build_extents ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  They are placed at GOAL if possible,
+   otherwise as soon after it as possible.  A GOAL of 0 means no
+   preference.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+free_map_allocate (size_t cnt, block_sector_t goal, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  bool success;
+
+  ASSERT (cnt > 0);
+
+  journal_begin ();
+  lock_acquire (&free_map_lock);
+  reclaim_pending ();
+  success = allocate (cnt, goal, sectorp);
+  if (!success && !list_empty (&pending_list))
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      /* Committing makes the pending sectors available. */
+      lock_release (&free_map_lock);
+      journal_commit ();
+      lock_acquire (&free_map_lock);
+      reclaim_pending ();
+      success = allocate (cnt, goal, sectorp);
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  if (success)
+    {
+      write_bits (*sectorp, cnt);
+      alloc_cnt++;
+    }
+  lock_release (&free_map_lock);
+  journal_end ();
+  return success;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use, once
+   the running journal transaction commits. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  struct extent *x = NULL;
+  unsigned txn;
+
+  journal_begin ();
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  write_bits (sector, cnt);
+  journal_revoke (sector, cnt);
+  release_cnt++;
+
+  /* Files are usually released a sector at a time, in order, so
+     try to extend the last pending extent. */
+  txn = journal_txn ();
+  if (!list_empty (&pending_list))
+    x = list_entry (list_back (&pending_list), struct extent, elem);
+  if (x != NULL && x->txn == txn && extent_end (x) == sector)
+    x->cnt += cnt;
+  else
+    {
+      /* If no memory is available, the sectors are free in the
+         bitmap but will not be allocated again until the free map
+         is next opened. */
+      x = kmem_cache_alloc (extent_cache);
+      if (x != NULL)
+        {
+          x->start = sector;
+          x->cnt = cnt;
+          x->txn = txn;
+          list_push_back (&pending_list, &x->elem);
+        }
+    }
+  lock_release (&free_map_lock);
+  journal_end ();
 }
 
 /* Opens the free map file and reads it from disk. */
 void
-free_map_open (void) 
+free_map_open (void)
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  build_extents ();
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Closes the free map file. */
 void
-free_map_close (void) 
+free_map_close (void)
 {
   file_close (free_map_file);
+  free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void
-free_map_create (void) 
+free_map_create (void)
 {
+  struct file *file;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The file starts out as a hole, so the
+     first write allocates its sectors, which changes the bitmap,
+     and the second writes the final bitmap over them.
+     free_map_file stays null until then, because write_bits()
+     would otherwise write to the file in the middle of the first
+     write, which holds its inode's lock. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file) || !bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  free_map_file = file;
+}
+
+/* Prints free map statistics. */
+void
+free_map_print_stats (void)
+{
+  block_sector_t free_cnt = 0;
+  size_t extent_cnt = 0;
+  struct list_elem *e;
+
+  for (e = list_begin (&extent_list); e != list_end (&extent_list);
+       e = list_next (e))
+    {
+      free_cnt += list_entry (e, struct extent, elem)->cnt;
+      extent_cnt++;
+    }
+  printf ("Free map: %lld allocations, %lld releases, "
+          "%lld bitmap writes, %"PRDSNu" sectors free in %zu extents\n",
+          alloc_cnt, release_cnt, write_cnt, free_cnt, extent_cnt);
+}
+
+/* Rebuilds the list of free extents from the bitmap. */
+static void
+build_extents (void)
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t start = 0;
+
+  while (!list_empty (&extent_list))
+    kmem_cache_free (extent_cache,
+                     list_entry (list_pop_front (&extent_list),
+                                 struct extent, elem));
+  while (!list_empty (&pending_list))
+    kmem_cache_free (extent_cache,
+                     list_entry (list_pop_front (&pending_list),
+                                 struct extent, elem));
+
+  for (;;)
+    {
+      struct extent *x;
+      size_t end;
+
+      start = bitmap_scan (free_map, start, 1, false);
+      if (start == BITMAP_ERROR)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = sector_cnt;
+
+      x = kmem_cache_alloc (extent_cache);
+      if (x == NULL)
+        PANIC ("can't allocate free extent");
+      x->start = start;
+      x->cnt = end - start;
+      list_push_back (&extent_list, &x->elem);
+      start = end;
+    }
+  cursor = list_begin (&extent_list);
+}
+
+/* Allocates CNT consecutive sectors, at GOAL or as soon after it
+   as possible, and stores the first into *SECTORP.  Returns true
+   if successful, false if there is no room. */
+static bool
+allocate (size_t cnt, block_sector_t goal, block_sector_t *sectorp)
+{
+  struct list_elem *first, *e;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  if (goal == 0)
+    first = cursor;
+  else
+    first = extent_after (goal);
+  if (first == list_end (&extent_list))
+    first = list_begin (&extent_list);
+
+  /* Try every extent once, starting from FIRST and wrapping
+     around. */
+  e = first;
+  if (e != list_end (&extent_list))
+    do
+      {
+        struct extent *x = list_entry (e, struct extent, elem);
+        block_sector_t start = x->start;
+
+        if (goal > x->start && goal < extent_end (x)
+            && extent_end (x) - goal >= cnt)
+          start = goal;
+        if (extent_end (x) - start >= cnt)
+          {
+            /* Allocating in the middle of the extent splits it,
+               which needs memory.  Without it, settle for the
+               start of the extent. */
+            if (!take_sectors (x, start, cnt))
+              {
+                start = x->start;
+                take_sectors (x, start, cnt);
+              }
+            *sectorp = start;
+            return true;
+          }
+
+        e = list_next (e);
+        if (e == list_end (&extent_list))
+          e = list_begin (&extent_list);
+      }
+    while (e != first);
+  return false;
+}
+
+/* Adds free extent X to the list, merging it with its neighbors
+   if they touch it, which frees X. */
+static void
+add_extent (struct extent *x)
+{
+  struct list_elem *next_elem, *prev_elem;
+  struct extent *next = NULL;
+  struct extent *prev = NULL;
+
+  /* Find the extents before and after X. */
+  next_elem = extent_after (x->start);
+  if (next_elem != list_end (&extent_list))
+    next = list_entry (next_elem, struct extent, elem);
+  if (next_elem != list_begin (&extent_list))
+    {
+      prev_elem = list_prev (next_elem);
+      prev = list_entry (prev_elem, struct extent, elem);
+    }
+
+  /* Merge with them, or insert X between them. */
+  if (prev != NULL && extent_end (prev) == x->start)
+    {
+      prev->cnt += x->cnt;
+      kmem_cache_free (extent_cache, x);
+      if (next != NULL && extent_end (prev) == next->start)
+        {
+          prev->cnt += next->cnt;
+          if (cursor == &next->elem)
+            cursor = &prev->elem;
+          list_remove (&next->elem);
+          kmem_cache_free (extent_cache, next);
+        }
+    }
+  else if (next != NULL && extent_end (x) == next->start)
+    {
+      next->start = x->start;
+      next->cnt += x->cnt;
+      kmem_cache_free (extent_cache, x);
+    }
+  else
+    list_insert (next_elem, &x->elem);
+}
+
+/* Moves the pending extents whose transactions have committed
+   to the free extents. */
+static void
+reclaim_pending (void)
+{
+  struct list_elem *e = list_begin (&pending_list);
+
+  while (e != list_end (&pending_list))
+    {
+      struct extent *x = list_entry (e, struct extent, elem);
+
+      e = list_next (e);
+      if (journal_is_committed (x->txn))
+        {
+          list_remove (&x->elem);
+          add_extent (x);
+        }
+    }
+}
+
+/* Returns the first free extent that ends after SECTOR, that is,
+   the one that contains SECTOR or else the first one after it,
+   or the end of the list if there is none.  Starts looking at
+   the cursor, which is usually close. */
+static struct list_elem *
+extent_after (block_sector_t sector)
+{
+  struct list_elem *e = cursor;
+
+  while (e != list_begin (&extent_list)
+         && extent_end (list_entry (list_prev (e), struct extent, elem))
+            > sector)
+    e = list_prev (e);
+  while (e != list_end (&extent_list)
+         && extent_end (list_entry (e, struct extent, elem)) <= sector)
+    e = list_next (e);
+  return e;
+}
+
+/* Removes the CNT sectors starting at START, which must lie
+   within free extent X, from X, and marks them in use.  Returns
+   false without doing anything if that would split X in two and
+   no memory is available for the second half. */
+static bool
+take_sectors (struct extent *x, block_sector_t start, size_t cnt)
+{
+  block_sector_t end = start + cnt;
+
+  ASSERT (start >= x->start && end <= extent_end (x));
+
+  if (start == x->start)
+    {
+      x->start += cnt;
+      x->cnt -= cnt;
+      cursor = &x->elem;
+      if (x->cnt == 0)
+        {
+          cursor = list_remove (&x->elem);
+          kmem_cache_free (extent_cache, x);
+        }
+    }
+  else if (end == extent_end (x))
+    {
+      x->cnt -= cnt;
+      cursor = list_next (&x->elem);
+    }
+  else
+    {
+      struct extent *rest = kmem_cache_alloc (extent_cache);
+      if (rest == NULL)
+        return false;
+      rest->start = end;
+      rest->cnt = extent_end (x) - end;
+      x->cnt = start - x->start;
+      list_insert (list_next (&x->elem), &rest->elem);
+      cursor = &rest->elem;
+    }
+
+  bitmap_set_multiple (free_map, start, cnt, true);
+  return true;
+}
+
+/* Writes the bits for the CNT sectors starting at SECTOR to the
+   free map file, if it is open. */
+static void
+write_bits (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / 8;
+  size_t last = (sector + cnt - 1) / 8;
+
+  if (free_map_file == NULL)
+    return;
+  if (!bitmap_write_range (free_map, free_map_file, first, last - first + 1))
     PANIC ("can't write free map");
+  write_cnt++;
 }
@@ -1,78 +1,310 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Layout of the sector pointers in an inode: DIRECT_CNT that
+   point to data sectors, then one that points to an indirect
+   block of PTRS_PER_SECTOR pointers to data sectors, then one
+   that points to a doubly indirect block of pointers to
+   indirect blocks.  A pointer of 0 means that no sector has been
+   allocated: sector 0 holds the free map's inode, so it is never
+   used for anything else. */
+#define DIRECT_CNT 123
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define SECTOR_CNT (DIRECT_CNT + 2)
+#define PTRS_PER_SECTOR ((off_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Largest file size, in bytes. */
+#define INODE_SPAN ((DIRECT_CNT + PTRS_PER_SECTOR                    \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)            \
+                    * BLOCK_SECTOR_SIZE)
+
+/* Largest inline file, in bytes.  An inline file keeps its data
+   in its inode, in place of the sector pointers, so that reading
+   it takes no disk I/O once the inode is in memory.  A file is
+   created inline if it is small enough, and moved out into a
+   data sector when it grows past INLINE_MAX bytes, after which
+   it stays that way. */
+#define INLINE_MAX (SECTOR_CNT * (off_t) sizeof (block_sector_t))
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    union
+      {
+        block_sector_t sectors[SECTOR_CNT]; /* Sector pointers. */
+        uint8_t inline_data[INLINE_MAX];    /* Data, if IS_INLINE. */
+      };
+    uint8_t is_dir;                     /* 1 for a directory, else 0. */
+    uint8_t is_inline;                  /* 1 for an inline file, else 0. */
+    uint8_t unused[2];                  /* Not used. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* In-memory inode.
 
-/* In-memory inode. */
+   OPEN_CNT and REMOVED are protected by inode_table_lock, and
+   the rest, other than the constant SECTOR, by RW.  Reads hold
+   RW shared, so that they run in parallel, and writes hold it
+   exclusively.  LOCK belongs to the callers of inode_lock(). */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in inode_map. */
+    struct list_elem lru_elem;          /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    struct rwlock rw;                   /* Protects the members below. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool watched;                       /* Report changes to change_hook? */
+    off_t read_end;                     /* Where the last read ended. */
     struct inode_disk data;             /* Inode content. */
+    struct lock lock;                   /* For inode_lock(). */
   };
 
+/* Returns pointer IDX in indirect block TABLE, or 0 if TABLE is
+   0. */
+static block_sector_t
+index_lookup (block_sector_t table, off_t idx)
+{
+  block_sector_t sector = 0;
+
+  if (table != 0)
+    cache_read_at (table, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within the file whose on-disk inode is DISK.
+   Returns 0 if no sector has been allocated for it. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (const struct inode_disk *disk, off_t pos) 
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  off_t idx = pos / BLOCK_SECTOR_SIZE;
+
+  ASSERT (pos >= 0 && pos < INODE_SPAN);
+  ASSERT (!disk->is_inline);
+  if (idx < DIRECT_CNT)
+    return disk->sectors[idx];
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return index_lookup (disk->sectors[INDIRECT_IDX], idx);
+  idx -= PTRS_PER_SECTOR;
+  return index_lookup (index_lookup (disk->sectors[DBL_INDIRECT_IDX],
+                                    idx / PTRS_PER_SECTOR),
+                      idx % PTRS_PER_SECTOR);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR at offset OFS.
+   Metadata, as opposed to file data, is written through the
+   journal, as part of the running thread's operation. */
+static void
+write_sector (block_sector_t sector, const void *buffer, size_t ofs,
+              size_t size, bool meta)
+{
+  if (meta)
+    journal_write (sector, buffer, ofs, size);
   else
-    return -1;
+    cache_write_at (sector, buffer, ofs, size);
+}
+
+/* Allocates a sector, as close after GOAL as possible, fills it
+   with zeros, and stores its number in *SECTORP.  The sector
+   holds metadata if META is true.  Returns false if the disk is
+   full. */
+static bool
+allocate_zeroed (block_sector_t goal, block_sector_t *sectorp, bool meta)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate (1, goal, sectorp))
+    return false;
+  write_sector (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE, meta);
+  return true;
+}
+
+/* Makes sure that pointer *SLOT in an on-disk inode points to a
+   sector, allocating one near GOAL if necessary, which holds
+   metadata if META is true.  Returns false if the disk is
+   full. */
+static bool
+allocate_direct (block_sector_t goal, block_sector_t *slot, bool meta)
+{
+  return *slot != 0 || allocate_zeroed (goal, slot, meta);
+}
+
+/* Stores pointer IDX in indirect block TABLE into *SECTORP,
+   first allocating a sector near GOAL for it if necessary, which
+   holds metadata if META is true.  Returns false if the disk is
+   full. */
+static bool
+allocate_indirect (block_sector_t table, off_t idx, block_sector_t goal,
+                   block_sector_t *sectorp, bool meta)
+{
+  *sectorp = index_lookup (table, idx);
+  if (*sectorp == 0)
+    {
+      if (!allocate_zeroed (goal, sectorp, meta))
+        return false;
+      journal_write (table, sectorp, idx * sizeof *sectorp, sizeof *sectorp);
+    }
+  return true;
+}
+
+/* Allocates the sector that holds byte offset POS within the
+   file whose on-disk inode is DISK, along with any indirect
+   blocks needed to reach it, unless they are allocated already,
+   and stores its number in *SECTORP.  New sectors are zeroed
+   and placed as close after GOAL as the free map allows.  The
+   file's data is metadata if META is true, as for a directory.
+   The caller must write DISK back to disk.  Returns false if the
+   disk is full. */
+static bool
+allocate_sector (struct inode_disk *disk, off_t pos, block_sector_t goal,
+                 block_sector_t *sectorp, bool meta)
+{
+  off_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t table;
+
+  ASSERT (pos >= 0 && pos < INODE_SPAN);
+  ASSERT (!disk->is_inline);
+  if (idx < DIRECT_CNT)
+    {
+      if (!allocate_direct (goal, &disk->sectors[idx], meta))
+        return false;
+      *sectorp = disk->sectors[idx];
+      return true;
+    }
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return (allocate_direct (goal, &disk->sectors[INDIRECT_IDX], true)
+            && allocate_indirect (disk->sectors[INDIRECT_IDX], idx, goal,
+                                  sectorp, meta));
+  idx -= PTRS_PER_SECTOR;
+  return (allocate_direct (goal, &disk->sectors[DBL_INDIRECT_IDX], true)
+          && allocate_indirect (disk->sectors[DBL_INDIRECT_IDX],
+                                idx / PTRS_PER_SECTOR, goal, &table, true)
+          && allocate_indirect (table, idx % PTRS_PER_SECTOR, goal,
+                                sectorp, meta));
+}
+
+/* Frees SECTOR, which is a data sector if DEPTH is 0, an
+   indirect block if DEPTH is 1, or a doubly indirect block if
+   DEPTH is 2, along with all the sectors it points to.  Does
+   nothing if SECTOR is 0. */
+static void
+release_index (block_sector_t sector, int depth)
+{
+  if (sector == 0)
+    return;
+  if (depth > 0)
+    {
+      off_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        release_index (index_lookup (sector, i), depth - 1);
+    }
+  free_map_release (sector, 1);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Frees all the data and indirect blocks of the file whose
+   on-disk inode is DISK.  An inline file has none. */
+static void
+release_sectors (struct inode_disk *disk)
+{
+  int i;
+
+  if (disk->is_inline)
+    return;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_index (disk->sectors[i], 0);
+  release_index (disk->sectors[INDIRECT_IDX], 1);
+  release_index (disk->sectors[DBL_INDIRECT_IDX], 2);
+}
+
+/* Number of inodes kept in memory after they are closed. */
+#define CLOSED_MAX 64
+
+/* Inodes in memory, by sector, so that opening a single inode
+   twice returns the same `struct inode'.  Besides the open
+   inodes, up to CLOSED_MAX inodes that have been closed stay
+   here, so that opening one of them again does not have to read
+   its sector. */
+static struct hash inode_map;
+
+/* Inodes in inode_map that are not open, least recently closed
+   first. */
+static struct list closed_inodes;
+static size_t closed_cnt;
+
+/* Protects inode_map, closed_inodes, the statistics below, and
+   the OPEN_CNT and REMOVED members of every inode. */
+static struct lock inode_table_lock;
+
+/* Cache of struct inode. */
+static struct kmem_cache *inode_cache;
+
+/* Statistics. */
+static long long hit_cnt;               /* Opens of inodes in memory. */
+static long long reuse_cnt;             /* ...that had been closed. */
+static long long read_cnt;              /* Opens that read the sector. */
+
+/* Reads of inline files.  Not locked, so readers running in
+   parallel may lose a count now and then. */
+static long long inline_read_cnt;
+
+/* Told about changes to watched inodes, if set. */
+static inode_change_func *change_hook;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static struct inode *lookup (block_sector_t);
+static void evict (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&inode_map, inode_hash, inode_less, NULL);
+  list_init (&closed_inodes);
+  lock_init (&inode_table_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true, an
+   ordinary file otherwise.  No data sectors are allocated: the
+   whole file is a hole, which reads as zeros, and each sector is
+   allocated when it is first written, so that creating a file
+   takes the same time whatever its LENGTH.  Writing may then
+   find the disk full, as when extending a file.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is too
+   large. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
+  struct inode *inode;
   bool success = false;
 
   ASSERT (length >= 0);
@@ -81,27 +313,29 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  /* An inode that used to be in SECTOR may still be in memory. */
+  lock_acquire (&inode_table_lock);
+  inode = lookup (sector);
+  if (inode != NULL)
+    {
+      ASSERT (inode->open_cnt == 0);
+      evict (inode);
+    }
+  lock_release (&inode_table_lock);
+
+  journal_begin ();
   disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+  if (disk_inode != NULL && length <= INODE_SPAN)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
-      free (disk_inode);
+      disk_inode->is_dir = is_dir;
+      disk_inode->is_inline = !is_dir && length <= INLINE_MAX;
+      journal_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true;
     }
+  free (disk_inode);
+  journal_end ();
   return success;
 }
 
@@ -111,33 +345,58 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  /* Check whether this inode is already in memory. */
+  lock_acquire (&inode_table_lock);
+  inode = lookup (sector);
+  if (inode != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      hit_cnt++;
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->lru_elem);
+          closed_cnt--;
+          reuse_cnt++;
         }
+      lock_release (&inode_table_lock);
+      return inode;
     }
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  /* Allocate memory, giving up a closed inode if there is no
+     other way. */
+  inode = kmem_cache_alloc (inode_cache);
+  if (inode == NULL && !list_empty (&closed_inodes))
+    {
+      evict (list_entry (list_front (&closed_inodes), struct inode,
+                         lru_elem));
+      inode = kmem_cache_alloc (inode_cache);
+    }
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&inode_table_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The sector is read without holding the table
+     lock, but with RW held, so that anyone else who opens the
+     inode meanwhile waits for the read to finish before using
+     it. */
   inode->sector = sector;
   inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  rwlock_init (&inode->rw);
+  inode->deny_write_cnt = 0;
+  inode->watched = false;
+  inode->read_end = 0;
+  lock_init (&inode->lock);
+  rwlock_acquire_write (&inode->rw);
+  hash_insert (&inode_map, &inode->elem);
+  read_cnt++;
+  lock_release (&inode_table_lock);
+
+  cache_read (inode->sector, &inode->data);
+  rwlock_release_write (&inode->rw);
   return inode;
 }
 
@@ -146,7 +405,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -157,9 +420,50 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (struct inode *inode)
+{
+  bool is_dir;
+
+  rwlock_acquire_read (&inode->rw);
+  is_dir = inode->data.is_dir != 0;
+  rwlock_release_read (&inode->rw);
+  return is_dir;
+}
+
+/* Returns true if INODE has been removed, false otherwise.  The
+   answer stays true once given, but a caller that needs a false
+   answer to stay false must hold the inode's lock across both
+   the check and the inode_remove() that would change it. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Acquires INODE's lock.  The inode module itself does not use
+   this lock.  It is for callers that make a series of calls on
+   INODE and need no one else to do the same in between. */
+void
+inode_lock (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock, which the caller must hold. */
+void
+inode_unlock (struct inode *inode)
+{
+  lock_release (&inode->lock);
+}
+
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE and INODE was a
+   removed inode, frees its memory and its blocks.  Otherwise,
+   INODE stays in memory for a while in case it is opened
+   again. */
 void
 inode_close (struct inode *inode) 
 {
@@ -168,21 +472,32 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  lock_acquire (&inode_table_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed.  No one else can find the
+         inode once it is out of the table, so that need not be
+         done with the lock held. */
       if (inode->removed) 
         {
+          hash_delete (&inode_map, &inode->elem);
+          lock_release (&inode_table_lock);
+          journal_begin ();
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_sectors (&inode->data);
+          journal_end ();
+          kmem_cache_free (inode_cache, inode);
+          return;
         }
 
-      free (inode); 
+      /* Keep it, making room by dropping the inode that was
+         closed longest ago. */
+      list_push_back (&closed_inodes, &inode->lru_elem);
+      if (++closed_cnt > CLOSED_MAX)
+        evict (list_entry (list_front (&closed_inodes), struct inode,
+                           lru_elem));
     }
+  lock_release (&inode_table_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -190,28 +505,45 @@ inode_close (struct inode *inode)
 void
 inode_remove (struct inode *inode) 
 {
+  bool watched;
+
   ASSERT (inode != NULL);
+  lock_acquire (&inode_table_lock);
   inode->removed = true;
+  lock_release (&inode_table_lock);
+
+  rwlock_acquire_write (&inode->rw);
+  watched = inode->watched;
+  inode->watched = false;
+  rwlock_release_write (&inode->rw);
+  if (watched)
+    change_hook (inode->sector);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   A read that continues where the previous one ended also asks
+   for the next sector to be read ahead. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool is_inline = false;
+  bool sequential;
+  off_t next;
 
+  rwlock_acquire_read (&inode->rw);
+  sequential = offset == inode->read_end;
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      off_t inode_left = inode->data.length - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,59 +552,129 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* The data of an inline file is at hand.  A sector that was
+         never written reads as zeros. */
+      if (inode->data.is_inline)
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          memcpy (buffer + bytes_read, inode->data.inline_data + offset,
+                  chunk_size);
+          is_inline = true;
         }
+      else if ((sector_idx = byte_to_sector (&inode->data, offset)) != 0)
+        cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+                       chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+  /* Readers running in parallel may each store their own end
+     here.  That only makes read-ahead less accurate. */
+  inode->read_end = offset;
+
+  /* Start reading the sector after the last one read. */
+  next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  if (sequential && bytes_read > 0 && next < inode->data.length)
+    {
+      block_sector_t next_sector = byte_to_sector (&inode->data, next);
+      if (next_sector != 0)
+        cache_read_ahead (next_sector);
+    }
+  rwlock_release_read (&inode->rw);
+
+  if (is_inline)
+    inline_read_cnt++;
 
   return bytes_read;
 }
 
+/* Moves the data of INODE, an inline file, into a data sector of
+   its own, which holds metadata if META is true.  The caller
+   must hold INODE's RW exclusively and write INODE to disk
+   afterward.  Returns false if the disk is full. */
+static bool
+move_out (struct inode *inode, bool meta)
+{
+  block_sector_t sector = 0;
+
+  ASSERT (inode->data.is_inline);
+
+  /* The bytes past the end of an inline file are zeros, so an
+     empty one becomes a file with no sectors as it is. */
+  if (inode->data.length > 0)
+    {
+      if (!allocate_zeroed (inode->sector + 1, &sector, meta))
+        return false;
+      write_sector (sector, inode->data.inline_data, 0, inode->data.length,
+                    meta);
+      memset (inode->data.inline_data, 0, inode->data.length);
+    }
+  inode->data.sectors[0] = sector;
+  inode->data.is_inline = false;
+  return true;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or the file would grow past
+   its largest possible size.  A write past end of file extends
+   the file.  Sectors are allocated only as they are written to,
+   so any gap left between the old end of file and OFFSET takes
+   no space and reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool changed = false;
+  bool watched;
+  bool meta;
 
+  journal_begin ();
+  rwlock_acquire_write (&inode->rw);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_write (&inode->rw);
+      journal_end ();
+      return 0;
+    }
+
+  /* The contents of directories and of the free map are
+     metadata. */
+  meta = inode->data.is_dir || inode->sector == FREE_MAP_SECTOR;
+
+  /* A write that an inline file has room for goes into its inode.
+     Any other first moves its data out, unless the disk is
+     full. */
+  if (size > 0 && inode->data.is_inline)
+    {
+      if (offset <= INLINE_MAX && size <= INLINE_MAX - offset)
+        {
+          memcpy (inode->data.inline_data + offset, buffer, size);
+          bytes_written = size;
+          offset += size;
+          size = 0;
+          changed = true;
+        }
+      else if (move_out (inode, meta))
+        changed = true;
+      else
+        size = 0;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in largest file, bytes left in sector, lesser
+         of the two. */
+      off_t inode_left = INODE_SPAN - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,49 +683,85 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      sector_idx = byte_to_sector (&inode->data, offset);
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          /* Try to put it right after the previous sector of the
+             file, or after the inode. */
+          block_sector_t goal = inode->sector;
+          if (offset >= BLOCK_SECTOR_SIZE)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              block_sector_t prev = byte_to_sector (&inode->data,
+                                                    offset - BLOCK_SECTOR_SIZE);
+              if (prev != 0)
+                goal = prev;
             }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          if (!allocate_sector (&inode->data, offset, goal + 1, &sector_idx,
+                                meta))
+            break;
+          changed = true;
         }
+      write_sector (sector_idx, buffer + bytes_written, sector_ofs,
+                    chunk_size, meta);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  watched = bytes_written > 0 && inode->watched;
+  if (watched)
+    inode->watched = false;
+  rwlock_release_write (&inode->rw);
+  journal_end ();
+
+  /* Whoever watched the inode no longer has an up-to-date view
+     of it. */
+  if (watched)
+    change_hook (inode->sector);
 
   return bytes_written;
 }
 
+/* Sets HOOK to be called when a watched inode changes.  See
+   inode_watch(). */
+void
+inode_set_change_hook (inode_change_func *hook)
+{
+  change_hook = hook;
+}
+
+/* Asks for the change hook to be called, once, the next time
+   INODE's file is written or removed, or INODE is dropped from
+   memory.  Writes to inodes nobody watches cost nothing
+   extra. */
+void
+inode_watch (struct inode *inode)
+{
+  ASSERT (change_hook != NULL);
+
+  rwlock_acquire_write (&inode->rw);
+  inode->watched = true;
+  rwlock_release_write (&inode->rw);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rw);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +770,77 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rw);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rw);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
-inode_length (const struct inode *inode)
+inode_length (struct inode *inode)
+{
+  off_t length;
+
+  rwlock_acquire_read (&inode->rw);
+  length = inode->data.length;
+  rwlock_release_read (&inode->rw);
+  return length;
+}
+
+/* Prints inode statistics. */
+void
+inode_print_stats (void)
+{
+  printf ("Inodes: %lld hits (%lld after close), %lld read, "
+          "%zu in memory (%zu closed), %lld inline reads\n",
+          hit_cnt, reuse_cnt, read_cnt, hash_size (&inode_map), closed_cnt,
+          inline_read_cnt);
+}
+
+/* Returns the in-memory inode for SECTOR, open or not, or a null
+   pointer if there is none. */
+static struct inode *
+lookup (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&inode_map, &key.elem);
+  return e != NULL ? hash_entry (e, struct inode, elem) : NULL;
+}
+
+/* Frees INODE, which must be closed.  A watcher is told, since
+   it would not hear about changes made once the inode is read
+   in again. */
+static void
+evict (struct inode *inode)
+{
+  ASSERT (inode->open_cnt == 0);
+
+  list_remove (&inode->lru_elem);
+  closed_cnt--;
+  hash_delete (&inode_map, &inode->elem);
+  if (inode->watched)
+    change_hook (inode->sector);
+  kmem_cache_free (inode_cache, inode);
+}
+
+/* Returns a hash value for the sector of inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Returns true if inode A is in a lower-numbered sector than
+   inode B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
 {
-  return inode->data.length;
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
 }
@@ -0,0 +1,506 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Metadata journal.
+
+   Changes to the file system's metadata (inodes, indirect blocks,
+   directories and the free map) are grouped into transactions,
+   each of which takes the file system from one consistent state
+   to another.  An operation, such as creating a file, brackets
+   its changes with journal_begin() and journal_end() and makes
+   them with journal_write() instead of writing to the buffer
+   cache directly.  An operation begun inside another one is part
+   of it.
+
+   Changed sectors stay in the buffer cache, which does not write
+   them back, until their transaction commits.  Committing writes
+   a descriptor that lists the sectors, a copy of each of them,
+   and a commit record with a checksum, one after another at the
+   start of the journal, and only then writes the sectors to
+   their own places.  If the machine stops before that is done,
+   journal_init() finds the transaction in the journal at the next
+   boot and writes its sectors again.  A transaction whose commit
+   record never reached the disk is ignored, which leaves the
+   file system as it was before it.
+
+   Many operations share a transaction, which is committed only
+   when it is full, when the flusher thread wakes up, and at
+   shutdown (group commit).  Operations that change the same
+   sectors, such as those on one directory, then cost little more
+   to commit than one of them.  With -jsync, each operation is
+   committed as soon as it ends instead.
+
+   File data is not journaled, only written back by the buffer
+   cache, so a file's last changes before a crash may be lost
+   while the file system stays consistent.  Sectors freed by a
+   transaction are dropped from it, and are not allocated again
+   until it has committed (see free-map.c), so replaying a
+   transaction never overwrites a sector that has become file
+   data since.
+
+   A transaction's sectors must stay in the buffer cache until it
+   commits, so it may hold at most half of the cache.  An
+   operation that would take a full transaction past that commits
+   it early, along with whatever other operations are part way
+   through it, so that those are split between two transactions.
+   Operations are kept small enough that this only happens with a
+   very small cache. */
+
+/* Commit each operation as it ends?  Set with -jsync. */
+bool journal_sync;
+
+/* Leave the last commit out of place at shutdown, as if the
+   machine stopped just after it?  Set with -jcrash. */
+bool journal_crash;
+
+/* Most sectors in a transaction, as many as the descriptor can
+   list. */
+#define LOG_CNT 125
+
+/* Sectors that an operation usually changes, at most.  A
+   transaction without room for that many more for each
+   operation part way through it, and for one more operation, is
+   committed before the operation begins. */
+#define OP_SECTOR_CNT 8
+
+/* Identify descriptors and commit records. */
+#define DESCRIPTOR_MAGIC 0x4a444553
+#define COMMIT_MAGIC 0x4a434d54
+
+/* Journal descriptor, in JOURNAL_SECTOR.  The copies of the
+   sectors it lists follow it, then the commit record.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct descriptor
+  {
+    unsigned magic;                     /* DESCRIPTOR_MAGIC. */
+    uint32_t txn;                       /* Transaction number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[LOG_CNT];    /* Where each copy belongs. */
+  };
+
+/* Commit record.  Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct commit_record
+  {
+    unsigned magic;                     /* COMMIT_MAGIC. */
+    uint32_t txn;                       /* Transaction number. */
+    unsigned checksum;                  /* Hash of descriptor and copies. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 12];
+  };
+
+/* A transaction. */
+struct txn
+  {
+    unsigned id;                        /* Transaction number, not 0. */
+    int op_cnt;                         /* Operations not yet ended. */
+    bool locked;                        /* No more operations may join? */
+    bool early;                         /* Commit without waiting for them? */
+    size_t sector_cnt;                  /* Number of sectors changed. */
+    block_sector_t sectors[LOG_CNT];    /* Sectors changed. */
+    bool revoked[LOG_CNT];              /* Freed since they were changed? */
+  };
+
+/* Operations join the running transaction.  The other one is
+   being committed, or idle. */
+static struct txn txns[2];
+static struct txn *running;
+static unsigned committed_id;           /* Last transaction committed. */
+static size_t txn_max;                  /* Most sectors in a transaction. */
+static bool crashing;                   /* Skip writing commits home? */
+
+/* Protects all of the above. */
+static struct lock journal_lock;
+
+/* Signaled when an operation ends and when a commit finishes. */
+static struct condition journal_changed;
+
+/* Held throughout a commit, so that there is one at a time. */
+static struct lock commit_lock;
+
+/* The descriptor, copies and commit record of the transaction
+   being committed or replayed, in the order they go on disk. */
+static uint8_t *log_buf;
+
+/* Statistics. */
+static long long op_cnt;
+static long long commit_cnt;
+static long long early_cnt;
+static long long logged_cnt;
+static long long replayed_cnt;
+
+static void commit (bool early);
+static unsigned replay (void);
+static void write_descriptor (unsigned txn, size_t cnt);
+
+/* Returns the address of sector IDX of the log. */
+static inline void *
+log_sector (size_t idx)
+{
+  return log_buf + idx * BLOCK_SECTOR_SIZE;
+}
+
+/* Sets up the journal and, unless FORMAT is true, writes the last
+   transaction found in it to where it belongs.  Must run before
+   anything else reads the file system. */
+void
+journal_init (bool format)
+{
+  unsigned last;
+
+  ASSERT (sizeof (struct descriptor) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct commit_record) == BLOCK_SECTOR_SIZE);
+  ASSERT (LOG_CNT + 2 <= JOURNAL_SECTOR_CNT);
+
+  log_buf = palloc_get_multiple (PAL_ASSERT,
+                                 DIV_ROUND_UP ((LOG_CNT + 2)
+                                               * BLOCK_SECTOR_SIZE, PGSIZE));
+  txn_max = cache_sector_cnt / 2;
+  if (txn_max > LOG_CNT)
+    txn_max = LOG_CNT;
+  else if (txn_max == 0)
+    txn_max = 1;
+  lock_init (&journal_lock);
+  cond_init (&journal_changed);
+  lock_init (&commit_lock);
+
+  if (format)
+    {
+      last = 0;
+      write_descriptor (last, 0);
+    }
+  else
+    last = replay ();
+
+  running = &txns[0];
+  running->id = last + 1;
+  committed_id = last;
+}
+
+/* Commits the running transaction and, unless -jcrash was given,
+   marks the journal empty, so that nothing is replayed at the
+   next boot. */
+void
+journal_done (void)
+{
+  lock_acquire (&journal_lock);
+  crashing = journal_crash;
+  commit (false);
+  lock_release (&journal_lock);
+
+  if (!journal_crash)
+    {
+      lock_acquire (&commit_lock);
+      write_descriptor (committed_id, 0);
+      lock_release (&commit_lock);
+    }
+}
+
+/* Begins an operation, which becomes part of the running
+   transaction, or joins the one already begun by the running
+   thread.  The outermost call must be made before taking any
+   lock that an operation in progress might need, because it may
+   have to wait for those operations to end. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      struct txn *x = running;
+
+      if (x->locked)
+        cond_wait (&journal_changed, &journal_lock);
+      else if ((x->op_cnt > 0 || x->sector_cnt > 0)
+               && x->sector_cnt + (x->op_cnt + 1) * OP_SECTOR_CNT > txn_max)
+        commit (false);
+      else
+        break;
+    }
+  running->op_cnt++;
+  op_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends the operation begun by the matching journal_begin(). */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (running->op_cnt > 0);
+  if (--running->op_cnt == 0)
+    cond_broadcast (&journal_changed, &journal_lock);
+  if (journal_sync && running->sector_cnt > 0)
+    commit (false);
+  lock_release (&journal_lock);
+}
+
+/* Returns the index of SECTOR in transaction X's list of changed
+   sectors, or -1 if it is not there. */
+static int
+find_sector (const struct txn *x, block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < x->sector_cnt; i++)
+    if (x->sectors[i] == sector)
+      return i;
+  return -1;
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at offset
+   OFS, as part of the running thread's operation. */
+void
+journal_write (block_sector_t sector, const void *buffer,
+               size_t ofs, size_t size)
+{
+  int idx;
+
+  ASSERT (thread_current ()->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  while ((idx = find_sector (running, sector)) < 0
+         && running->sector_cnt >= txn_max)
+    commit (true);
+  if (idx < 0)
+    {
+      idx = running->sector_cnt++;
+      running->sectors[idx] = sector;
+      running->revoked[idx] = false;
+    }
+  ASSERT (!running->revoked[idx]);
+  cache_write_txn (sector, buffer, ofs, size, running->id);
+  lock_release (&journal_lock);
+}
+
+/* Drops the CNT sectors starting at SECTOR, which are being
+   freed, from the running transaction, so that they are not
+   written to the journal. */
+void
+journal_revoke (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < running->sector_cnt; i++)
+    if (running->sectors[i] >= sector && running->sectors[i] < sector + cnt)
+      running->revoked[i] = true;
+  lock_release (&journal_lock);
+}
+
+/* Returns the number of the running transaction. */
+unsigned
+journal_txn (void)
+{
+  unsigned id;
+
+  lock_acquire (&journal_lock);
+  id = running->id;
+  lock_release (&journal_lock);
+  return id;
+}
+
+/* Returns true if transaction TXN has committed. */
+bool
+journal_is_committed (unsigned txn)
+{
+  bool committed;
+
+  lock_acquire (&journal_lock);
+  committed = txn <= committed_id;
+  lock_release (&journal_lock);
+  return committed;
+}
+
+/* Commits the running transaction and waits until it is on disk.
+   Called during an operation, commits early, without waiting for
+   the operation to end. */
+void
+journal_commit (void)
+{
+  lock_acquire (&journal_lock);
+  commit (thread_current ()->journal_depth > 0);
+  lock_release (&journal_lock);
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %lld operations, %lld commits (%lld early), "
+          "%lld sectors logged, %lld replayed\n",
+          op_cnt, commit_cnt, early_cnt, logged_cnt, replayed_cnt);
+}
+
+/* Writes the sectors listed in the log's descriptor, whose copies
+   follow it in the log, where they belong. */
+static void
+write_home (void)
+{
+  struct descriptor *d = log_sector (0);
+  size_t i;
+
+  for (i = 0; i < d->cnt; i++)
+    block_write (fs_device, d->sectors[i], log_sector (i + 1));
+}
+
+/* Commits the running transaction, X.  Unless EARLY, first waits
+   for the operations in X to end.  The caller must hold
+   journal_lock, which is released meanwhile.  Does nothing if
+   another thread commits X in the meantime. */
+static void
+commit (bool early)
+{
+  struct txn *x = running;
+  struct txn *next;
+  struct descriptor *d = log_sector (0);
+  struct commit_record *c;
+  unsigned id = x->id;
+  size_t cnt, i;
+
+  /* A commit that is waiting for the operations in X would wait
+     for this one forever.  Let it go ahead without them. */
+  if (early)
+    {
+      x->early = true;
+      cond_broadcast (&journal_changed, &journal_lock);
+    }
+
+  lock_release (&journal_lock);
+  lock_acquire (&commit_lock);
+  lock_acquire (&journal_lock);
+  if (running != x || x->id != id)
+    {
+      lock_release (&commit_lock);
+      return;
+    }
+
+  x->locked = true;
+  while (x->op_cnt > 0 && !x->early)
+    cond_wait (&journal_changed, &journal_lock);
+  if (x->sector_cnt == 0)
+    {
+      x->locked = x->early = false;
+      cond_broadcast (&journal_changed, &journal_lock);
+      lock_release (&commit_lock);
+      return;
+    }
+
+  /* Copy the sectors while no one can change them, then start
+     the next transaction. */
+  cnt = 0;
+  for (i = 0; i < x->sector_cnt; i++)
+    if (!x->revoked[i])
+      {
+        d->sectors[cnt] = x->sectors[i];
+        cache_read_txn (x->sectors[i], log_sector (cnt + 1));
+        cnt++;
+      }
+  next = &txns[x == &txns[0]];
+  next->id = id + 1;
+  next->op_cnt = x->early ? x->op_cnt : 0;
+  next->locked = next->early = false;
+  next->sector_cnt = 0;
+  running = next;
+  commit_cnt++;
+  if (x->early)
+    early_cnt++;
+  logged_cnt += cnt;
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+
+  /* Write the descriptor and the copies, then the commit record,
+     then the sectors' own places. */
+  d->magic = DESCRIPTOR_MAGIC;
+  d->txn = id;
+  d->cnt = cnt;
+  memset (d->sectors + cnt, 0, (LOG_CNT - cnt) * sizeof *d->sectors);
+  c = log_sector (cnt + 1);
+  memset (c, 0, sizeof *c);
+  c->magic = COMMIT_MAGIC;
+  c->txn = id;
+  c->checksum = hash_bytes (log_buf, (cnt + 1) * BLOCK_SECTOR_SIZE);
+  for (i = 0; i <= cnt + 1; i++)
+    block_write (fs_device, JOURNAL_SECTOR + i, log_sector (i));
+  if (!crashing)
+    {
+      write_home ();
+
+      /* Let the cache write back or evict the sectors again, if no
+         newer transaction has changed them. */
+      cnt = 0;
+      for (i = 0; i < x->sector_cnt; i++)
+        cache_end_txn (x->sectors[i], id,
+                       x->revoked[i] ? NULL : log_sector (++cnt));
+    }
+
+  lock_acquire (&journal_lock);
+  committed_id = id;
+  x->locked = x->early = false;
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&commit_lock);
+}
+
+/* Writes the transaction in the journal where it belongs, if it
+   committed.  Returns its number, or 0 if the journal has never
+   held one. */
+static unsigned
+replay (void)
+{
+  struct descriptor *d = log_sector (0);
+  struct commit_record *c;
+  size_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, d);
+  if (d->magic != DESCRIPTOR_MAGIC || d->cnt > LOG_CNT)
+    return 0;
+  if (d->cnt == 0)
+    return d->txn;
+
+  for (i = 0; i <= d->cnt; i++)
+    block_read (fs_device, JOURNAL_SECTOR + i + 1, log_sector (i + 1));
+  c = log_sector (d->cnt + 1);
+  if (c->magic == COMMIT_MAGIC && c->txn == d->txn
+      && c->checksum == hash_bytes (log_buf, (d->cnt + 1) * BLOCK_SECTOR_SIZE))
+    {
+      printf ("Replaying journal transaction %u (%u sectors)\n",
+              (unsigned) d->txn, (unsigned) d->cnt);
+      write_home ();
+      replayed_cnt += d->cnt;
+    }
+  return d->txn;
+}
+
+/* Writes a descriptor for transaction TXN, of CNT sectors, to the
+   journal.  With CNT 0, that says that the journal is empty. */
+static void
+write_descriptor (unsigned txn, size_t cnt)
+{
+  struct descriptor *d = log_sector (0);
+
+  memset (d, 0, sizeof *d);
+  d->magic = DESCRIPTOR_MAGIC;
+  d->txn = txn;
+  d->cnt = cnt;
+  block_write (fs_device, JOURNAL_SECTOR, d);
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Commit each operation as it ends?  Set with -jsync. */
+extern bool journal_sync;
+
+/* Leave the last commit out of place at shutdown?  Set with
+   -jcrash. */
+extern bool journal_crash;
+
+void journal_init (bool format);
+void journal_done (void);
+void journal_begin (void);
+void journal_end (void);
+void journal_write (block_sector_t, const void *, size_t ofs, size_t size);
+void journal_revoke (block_sector_t, size_t cnt);
+unsigned journal_txn (void);
+bool journal_is_committed (unsigned txn);
+void journal_commit (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
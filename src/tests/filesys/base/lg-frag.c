@@ -0,0 +1,53 @@
+/* Fills the disk with small files, deletes every other one, and
+   then creates, writes and reads back a file much larger than
+   any of the holes that leaves behind, so that the file cannot
+   be stored contiguously. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Size of each small file, and the most that are created. */
+#define SMALL_SIZE 20480
+#define SMALL_MAX 200
+
+/* Size of the large file. */
+#define LARGE_SIZE 204800
+
+static char buf[LARGE_SIZE];
+
+void
+test_main (void) 
+{
+  char name[16];
+  int cnt, i, fd;
+
+  msg ("fill disk with small files");
+  for (cnt = 0; cnt < SMALL_MAX; cnt++)
+    {
+      snprintf (name, sizeof name, "small%d", cnt);
+      if (!create (name, SMALL_SIZE))
+        break;
+    }
+  CHECK (cnt * SMALL_SIZE / 2 >= LARGE_SIZE,
+         "enough small files to fragment the disk");
+
+  msg ("remove every other small file");
+  for (i = 0; i < cnt; i += 2)
+    {
+      snprintf (name, sizeof name, "small%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("large", LARGE_SIZE), "create \"large\"");
+  CHECK ((fd = open ("large")) > 1, "open \"large\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"large\"");
+  msg ("close \"large\"");
+  close (fd);
+  check_file ("large", buf, sizeof buf);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-frag) begin
+(lg-frag) fill disk with small files
+(lg-frag) enough small files to fragment the disk
+(lg-frag) remove every other small file
+(lg-frag) create "large"
+(lg-frag) open "large"
+(lg-frag) write "large"
+(lg-frag) close "large"
+(lg-frag) open "large" for verification
+(lg-frag) verified contents of "large"
+(lg-frag) close "large"
+(lg-frag) end
+EOF
+pass;
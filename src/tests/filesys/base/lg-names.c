@@ -0,0 +1,43 @@
+/* Creates 10,000 empty files in one directory, then opens each
+   of them by name, in a different order, which makes every
+   operation a search of a large directory. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of files. */
+#define FILE_CNT 10000
+
+/* Step between files opened one after another.  Relatively prime
+   to FILE_CNT, so that every file is opened once. */
+#define STRIDE 7919
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i, fd;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "name%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+
+  msg ("open each file");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "name%d", i * STRIDE % FILE_CNT);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\"", name);
+      close (fd);
+    }
+
+  CHECK (open ("name-none") == -1, "open \"name-none\" (must fail)");
+  CHECK (!create ("name0", 0), "create \"name0\" again (must fail)");
+}
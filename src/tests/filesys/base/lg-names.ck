@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-names) begin
+(lg-names) create 10000 files
+(lg-names) open each file
+(lg-names) open "name-none" (must fail)
+(lg-names) create "name0" again (must fail)
+(lg-names) end
+EOF
+pass;
@@ -0,0 +1,63 @@
+/* Creates 500 files and keeps all of them open at once, then
+   opens each of them a second time, in a different order, so
+   that every open has to find the inode among hundreds of open
+   ones.  Finally closes them all and opens each once more. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of files. */
+#define FILE_CNT 500
+
+/* Step between files opened one after another.  Relatively prime
+   to FILE_CNT, so that every file is opened once. */
+#define STRIDE 293
+
+static int fds[FILE_CNT];
+
+/* Opens file number I and returns its fd. */
+static int
+open_file (int i) 
+{
+  char name[16];
+  int fd;
+
+  snprintf (name, sizeof name, "file%d", i);
+  fd = open (name);
+  if (fd < 2)
+    fail ("open \"%s\"", name);
+  return fd;
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  msg ("create %d files", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\"", name);
+    }
+
+  msg ("open all of them");
+  for (i = 0; i < FILE_CNT; i++)
+    fds[i] = open_file (i);
+
+  msg ("open each again while all are open");
+  for (i = 0; i < FILE_CNT; i++)
+    close (open_file (i * STRIDE % FILE_CNT));
+
+  msg ("close all of them");
+  for (i = 0; i < FILE_CNT; i++)
+    close (fds[i]);
+
+  msg ("open and close each again");
+  for (i = 0; i < FILE_CNT; i++)
+    close (open_file (i * STRIDE % FILE_CNT));
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-open) begin
+(lg-open) create 500 files
+(lg-open) open all of them
+(lg-open) open each again while all are open
+(lg-open) close all of them
+(lg-open) open and close each again
+(lg-open) end
+EOF
+pass;
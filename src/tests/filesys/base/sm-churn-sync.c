@@ -0,0 +1,6 @@
+/* Runs sm-churn with -jsync, which commits each file system
+   operation to the journal as it ends.  Comparing the journal
+   and block device statistics printed at shutdown with those of
+   sm-churn shows what group commit saves. */
+
+#include "tests/filesys/base/churn.inc"
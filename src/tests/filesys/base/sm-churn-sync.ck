@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-churn-sync) begin
+(sm-churn-sync) create and remove 10000 files, 50 at a time
+(sm-churn-sync) all rounds done
+(sm-churn-sync) end
+EOF
+pass;
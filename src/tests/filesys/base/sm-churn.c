@@ -0,0 +1,6 @@
+/* Creates and removes 10,000 small files, 50 at a time, which
+   exercises allocating and freeing inode and data sectors much
+   more than reading and writing them.  The statistics printed at
+   shutdown show how much work that took. */
+
+#include "tests/filesys/base/churn.inc"
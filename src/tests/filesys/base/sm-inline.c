@@ -0,0 +1,59 @@
+/* Writes and reads back many files small enough to be stored in
+   their inodes, then grows one of them past that size and checks
+   that its contents survive the move.  The inode statistics
+   printed at shutdown count the reads that needed no data
+   sector. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of small files, their size, and times each is read. */
+#define FILE_CNT 50
+#define FILE_SIZE 300
+#define READ_CNT 4
+
+/* Size that the first file grows to. */
+#define GROWN_SIZE 1300
+
+static char buf[GROWN_SIZE];
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fd, i;
+
+  for (i = 0; i < GROWN_SIZE; i++)
+    buf[i] = i % 251;
+
+  msg ("create and write %d files of %d bytes", FILE_CNT, FILE_SIZE);
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "inline%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      CHECK (write (fd, buf, FILE_SIZE) == FILE_SIZE, "write \"%s\"", name);
+      close (fd);
+    }
+
+  msg ("read each of them back %d times", READ_CNT);
+  for (i = 0; i < FILE_CNT * READ_CNT; i++)
+    {
+      snprintf (name, sizeof name, "inline%d", i % FILE_CNT);
+      check_file (name, buf, FILE_SIZE);
+    }
+  quiet = false;
+
+  CHECK ((fd = open ("inline0")) > 1, "open \"inline0\"");
+  seek (fd, FILE_SIZE);
+  CHECK (write (fd, buf + FILE_SIZE, GROWN_SIZE - FILE_SIZE)
+         == GROWN_SIZE - FILE_SIZE, "grow \"inline0\" to %d bytes",
+         GROWN_SIZE);
+  msg ("close \"inline0\"");
+  close (fd);
+  check_file ("inline0", buf, GROWN_SIZE);
+}
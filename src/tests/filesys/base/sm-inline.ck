@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-inline) begin
+(sm-inline) create and write 50 files of 300 bytes
+(sm-inline) read each of them back 4 times
+(sm-inline) open "inline0"
+(sm-inline) grow "inline0" to 1300 bytes
+(sm-inline) close "inline0"
+(sm-inline) open "inline0" for verification
+(sm-inline) verified contents of "inline0"
+(sm-inline) close "inline0"
+(sm-inline) end
+EOF
+pass;
@@ -0,0 +1,73 @@
+/* Child process for syn-mix.
+   An even-numbered child reads the file written by our parent
+   READ_CNT times, a chunk at a time.  An odd-numbered child
+   writes the same data to a file of its own, a chunk at a time,
+   and then reads it back. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-mix.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-syn-mix";
+
+static char buf1[BUF_SIZE];
+static char buf2[BUF_SIZE];
+
+/* Reads all of file NAME into buf2, a chunk at a time, and
+   checks it against buf1. */
+static void
+read_file (const char *name) 
+{
+  size_t ofs;
+  int fd;
+
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  for (ofs = 0; ofs < BUF_SIZE; ofs += CHUNK_SIZE)
+    CHECK (read (fd, buf2 + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+           "read %d bytes at offset %zu in \"%s\"", CHUNK_SIZE, ofs, name);
+  close (fd);
+  compare_bytes (buf2, buf1, BUF_SIZE, 0, name);
+}
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+
+  if (child_idx % 2 == 0)
+    {
+      int i;
+
+      for (i = 0; i < READ_CNT; i++)
+        read_file (file_name);
+    }
+  else
+    {
+      char name[16];
+      size_t ofs;
+      int fd;
+
+      snprintf (name, sizeof name, "file%d", child_idx);
+      CHECK (create (name, 0), "create \"%s\"", name);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      for (ofs = 0; ofs < BUF_SIZE; ofs += CHUNK_SIZE)
+        CHECK (write (fd, buf1 + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+               "write %d bytes at offset %zu in \"%s\"",
+               CHUNK_SIZE, ofs, name);
+      close (fd);
+      read_file (name);
+    }
+
+  return child_idx;
+}
@@ -0,0 +1,26 @@
+/* Creates directories /0/0/0 through /3/2/2 and files in the
+   leaf directories, then removes /3/2/2 and the files in it.
+   The kernel runs with -jcrash, so the last of these changes are
+   only in the journal when it stops, and the persistence check
+   passes only if the next boot replays them. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/extended/mk-tree.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char name[128];
+  int d;
+
+  make_tree (4, 3, 3, 4);
+  for (d = 0; d < 4; d++)
+    {
+      snprintf (name, sizeof name, "/3/2/2/%d", d);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  CHECK (remove ("/3/2/2"), "remove \"/3/2/2\"");
+}
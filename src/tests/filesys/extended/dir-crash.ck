@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-crash) begin
+(dir-crash) creating /0/0/0/0 through /3/2/2/3...
+(dir-crash) open "/0/2/0/3"
+(dir-crash) close "/0/2/0/3"
+(dir-crash) remove "/3/2/2/0"
+(dir-crash) remove "/3/2/2/1"
+(dir-crash) remove "/3/2/2/2"
+(dir-crash) remove "/3/2/2/3"
+(dir-crash) remove "/3/2/2"
+(dir-crash) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'a' => {'b' => {'c' => {'d' => {'e' => {'f' => {'g' =>
+                {'h' => {'none' => ['']}}}}}}}}});
+pass;
@@ -0,0 +1,62 @@
+/* Opens a file at the bottom of a deep directory tree many
+   times, by absolute and relative paths, and looks up a missing
+   file there as often, which makes every operation a walk down
+   the whole tree.  Then removes the file and checks that it can
+   no longer be found. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Number of times each path is looked up. */
+#define WALK_CNT 500
+
+static const char *dirs[] = {"/a", "/a/b", "/a/b/c", "/a/b/c/d",
+                             "/a/b/c/d/e", "/a/b/c/d/e/f",
+                             "/a/b/c/d/e/f/g", "/a/b/c/d/e/f/g/h"};
+
+void
+test_main (void) 
+{
+  size_t i;
+  int fd;
+
+  msg ("make tree");
+  for (i = 0; i < sizeof dirs / sizeof *dirs; i++)
+    if (!mkdir (dirs[i]))
+      fail ("mkdir \"%s\"", dirs[i]);
+  CHECK (create ("/a/b/c/d/e/f/g/h/file", 0),
+         "create \"/a/b/c/d/e/f/g/h/file\"");
+
+  msg ("open \"/a/b/c/d/e/f/g/h/file\" %d times", WALK_CNT);
+  for (i = 0; i < WALK_CNT; i++)
+    {
+      fd = open ("/a/b/c/d/e/f/g/h/file");
+      if (fd < 2)
+        fail ("open \"/a/b/c/d/e/f/g/h/file\"");
+      close (fd);
+    }
+
+  msg ("open \"/a/b/c/d/e/f/g/h/none\" %d times", WALK_CNT);
+  for (i = 0; i < WALK_CNT; i++)
+    if (open ("/a/b/c/d/e/f/g/h/none") != -1)
+      fail ("open \"/a/b/c/d/e/f/g/h/none\" succeeded");
+
+  CHECK (chdir ("/a/b/c/d"), "chdir \"/a/b/c/d\"");
+  msg ("open \"e/f/../f/g/./h/file\" %d times", WALK_CNT);
+  for (i = 0; i < WALK_CNT; i++)
+    {
+      fd = open ("e/f/../f/g/./h/file");
+      if (fd < 2)
+        fail ("open \"e/f/../f/g/./h/file\"");
+      close (fd);
+    }
+
+  CHECK (remove ("e/f/g/h/file"), "remove \"e/f/g/h/file\"");
+  CHECK (open ("/a/b/c/d/e/f/g/h/file") == -1,
+         "open \"/a/b/c/d/e/f/g/h/file\" (must fail)");
+  CHECK (create ("/a/b/c/d/e/f/g/h/none", 0),
+         "create \"/a/b/c/d/e/f/g/h/none\"");
+  CHECK ((fd = open ("e/f/g/h/none")) > 1, "open \"e/f/g/h/none\"");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-walk) begin
+(dir-walk) make tree
+(dir-walk) create "/a/b/c/d/e/f/g/h/file"
+(dir-walk) open "/a/b/c/d/e/f/g/h/file" 500 times
+(dir-walk) open "/a/b/c/d/e/f/g/h/none" 500 times
+(dir-walk) chdir "/a/b/c/d"
+(dir-walk) open "e/f/../f/g/./h/file" 500 times
+(dir-walk) remove "e/f/g/h/file"
+(dir-walk) open "/a/b/c/d/e/f/g/h/file" (must fail)
+(dir-walk) create "/a/b/c/d/e/f/g/h/none"
+(dir-walk) open "e/f/g/h/none"
+(dir-walk) end
+EOF
+pass;
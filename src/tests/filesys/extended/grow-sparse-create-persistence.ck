@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($half) = 512 * 1024;
+check_archive ({"sparse" => ["\0" x $half . "x" x 512
+                             . "\0" x ($half - 512)]});
+pass;
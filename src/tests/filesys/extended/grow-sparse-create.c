@@ -0,0 +1,45 @@
+/* Creates a 1 MB file, which takes no disk space until it is
+   written, writes one sector in the middle of it, and checks that
+   the rest still reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1024 * 1024)
+#define BLOCK_SIZE 512
+#define WRITE_OFS (FILE_SIZE / 2)
+
+static char block[BLOCK_SIZE];
+static char zeros[BLOCK_SIZE];
+static char buf[BLOCK_SIZE];
+
+void
+test_main (void) 
+{
+  const char *file_name = "sparse";
+  int fd, ofs;
+
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (filesize (fd) == FILE_SIZE, "filesize \"%s\"", file_name);
+
+  memset (block, 'x', sizeof block);
+  msg ("seek \"%s\"", file_name);
+  seek (fd, WRITE_OFS);
+  CHECK (write (fd, block, sizeof block) == sizeof block,
+         "write \"%s\"", file_name);
+
+  msg ("read \"%s\"", file_name);
+  seek (fd, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    {
+      if (read (fd, buf, sizeof buf) != sizeof buf)
+        fail ("read %d bytes at offset %d failed", BLOCK_SIZE, ofs);
+      compare_bytes (buf, ofs == WRITE_OFS ? block : zeros, sizeof buf,
+                     ofs, file_name);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
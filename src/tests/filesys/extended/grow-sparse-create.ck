@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-create) begin
+(grow-sparse-create) create "sparse"
+(grow-sparse-create) open "sparse"
+(grow-sparse-create) filesize "sparse"
+(grow-sparse-create) seek "sparse"
+(grow-sparse-create) write "sparse"
+(grow-sparse-create) read "sparse"
+(grow-sparse-create) close "sparse"
+(grow-sparse-create) end
+EOF
+pass;
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (16 * 1024);
+check_archive ({"child-syn-mix" => "tests/filesys/extended/child-syn-mix",
+		"data" => [$data],
+		"file1" => [$data],
+		"file3" => [$data],
+		"file5" => [$data],
+		"file7" => [$data]});
+pass;
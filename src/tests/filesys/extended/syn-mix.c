@@ -0,0 +1,29 @@
+/* Spawns 8 child processes at once.  Half of them read the same
+   file over and over, and the other half each write a file of
+   their own and read it back, so that reads of one file run
+   alongside each other and alongside writes to other files. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-mix.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  int fd;
+
+  CHECK (create (file_name, sizeof buf), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  exec_children ("child-syn-mix", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+}
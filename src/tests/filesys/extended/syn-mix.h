@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_MIX_H
+#define TESTS_FILESYS_EXTENDED_SYN_MIX_H
+
+#define BUF_SIZE (16 * 1024)
+#define CHUNK_SIZE 512
+#define READ_CNT 4
+#define CHILD_CNT 8
+static const char file_name[] = "data";
+
+#endif /* tests/filesys/extended/syn-mix.h */
@@ -0,0 +1,125 @@
+/* Measures how long the page allocator takes as the kernel pool
+   fills up.  At each of several occupancy levels, repeatedly
+   frees a random block and allocates one of a random size from
+   1 to 4 pages, checking that no two blocks overlap, and prints
+   the average number of CPU cycles per allocation.  A buddy
+   allocator should keep that number about the same at every
+   level. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define MAX_BLOCKS 1024         /* Most blocks held at once. */
+#define CHURN_CNT 500           /* Allocations per level. */
+
+/* A block held by the test. */
+struct block
+  {
+    uint32_t *pages;            /* First page. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static struct block blocks[MAX_BLOCKS];
+static size_t block_cnt;
+
+/* Reads the CPU's time-stamp counter. */
+static uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Allocates a block of PAGE_CNT pages into B and tags each of
+   its pages with the block's address. */
+static bool
+get_block (struct block *b, size_t page_cnt)
+{
+  size_t i;
+
+  b->pages = palloc_get_multiple (0, page_cnt);
+  if (b->pages == NULL)
+    return false;
+  b->page_cnt = page_cnt;
+  for (i = 0; i < page_cnt; i++)
+    b->pages[i * PGSIZE / sizeof *b->pages] = (uintptr_t) b->pages;
+  return true;
+}
+
+/* Checks the tags of block B and frees it. */
+static void
+put_block (struct block *b)
+{
+  size_t i;
+
+  for (i = 0; i < b->page_cnt; i++)
+    if (b->pages[i * PGSIZE / sizeof *b->pages] != (uintptr_t) b->pages)
+      fail ("block at %p overwritten", b->pages);
+  palloc_free_multiple (b->pages, b->page_cnt);
+}
+
+/* Returns a random block size from 1 to 4 pages. */
+static size_t
+random_size (void)
+{
+  return random_ulong () % 4 + 1;
+}
+
+void
+test_palloc_churn (void) 
+{
+  size_t capacity = 0;
+  int percent;
+
+  /* Measure the pool by allocating single pages until it is
+     empty. */
+  while (block_cnt < MAX_BLOCKS && get_block (&blocks[block_cnt], 1))
+    block_cnt++;
+  capacity = block_cnt;
+  while (block_cnt > 0)
+    put_block (&blocks[--block_cnt]);
+  if (capacity < 64)
+    fail ("only %zu pages available", capacity);
+
+  random_init (0);
+  for (percent = 20; percent <= 80; percent += 20)
+    {
+      size_t target = capacity * percent / 100;
+      size_t held = 0;
+      uint64_t cycles = 0;
+      int i;
+
+      /* Fill the pool up to the target occupancy. */
+      while (held < target)
+        {
+          if (!get_block (&blocks[block_cnt], random_size ()))
+            fail ("out of memory at %zu of %zu pages", held, capacity);
+          held += blocks[block_cnt++].page_cnt;
+        }
+
+      /* Churn. */
+      for (i = 0; i < CHURN_CNT; i++)
+        {
+          struct block *b = &blocks[random_ulong () % block_cnt];
+          uint64_t start;
+          bool ok;
+
+          put_block (b);
+          start = rdtsc ();
+          ok = get_block (b, random_size ());
+          cycles += rdtsc () - start;
+          if (!ok)
+            fail ("allocation failed at %d%% occupancy", percent);
+        }
+      msg ("%d%% full: %"PRIu64" cycles per allocation",
+           percent, cycles / CHURN_CNT);
+
+      while (block_cnt > 0)
+        put_block (&blocks[--block_cnt]);
+    }
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+s/: \d+ cycles per allocation$/: N cycles per allocation/ foreach @output;
+compare_output ("run", \@output, [<<'EOF']);
+(palloc-churn) begin
+(palloc-churn) 20% full: N cycles per allocation
+(palloc-churn) 40% full: N cycles per allocation
+(palloc-churn) 60% full: N cycles per allocation
+(palloc-churn) 80% full: N cycles per allocation
+(palloc-churn) end
+EOF
+pass;
@@ -0,0 +1,59 @@
+/* Bounces a turn counter kept in a file between a parent and a
+   child process, so that every turn needs a switch from one
+   address space to the other.  The kernel's "Timer:" and "TLB:"
+   statistics printed at shutdown give the cost and the number
+   of page directory loads. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TURN_CNT 40
+
+/* Waits for the counter in "token" to reach a value whose
+   parity is SIDE, then increments it, TURN_CNT / 2 times. */
+static void
+play (int side)
+{
+  int fd = open ("token");
+  int turns = 0;
+
+  if (fd < 0)
+    fail ("open \"token\" failed");
+  while (turns < TURN_CNT / 2)
+    {
+      unsigned char turn;
+
+      seek (fd, 0);
+      if (read (fd, &turn, 1) != 1)
+        fail ("read \"token\" failed");
+      if (turn % 2 != side)
+        continue;
+      turn++;
+      seek (fd, 0);
+      if (write (fd, &turn, 1) != 1)
+        fail ("write \"token\" failed");
+      turns++;
+    }
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  pid_t pid;
+
+  CHECK (create ("token", 1), "create \"token\"");
+  pid = fork ();
+  if (pid == 0)
+    {
+      play (1);
+      exit (0);
+    }
+  if (pid == -1)
+    fail ("fork failed");
+  play (0);
+  if (wait (pid) != 0)
+    fail ("child failed");
+  msg ("%d turns done", TURN_CNT);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(ctxsw-bench) begin
+(ctxsw-bench) create "token"
+(ctxsw-bench) 40 turns done
+(ctxsw-bench) end
+EOF
+pass;
@@ -0,0 +1,65 @@
+/* Runs a chain of concurrent instances of the same executable,
+   each of which execs the next one, to the depth given by the
+   first command-line argument.  The instances share the frames
+   of the read-only segments through the kernel's image cache,
+   so each one checks that its read-only table is intact and
+   that its writable data was not disturbed by the others. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "exec-shared";
+
+/* Read-only data, spanning several pages. */
+#define TABLE_CNT 4096
+static const unsigned table[TABLE_CNT] = { [0] = 1, [TABLE_CNT - 1] = 2 };
+
+/* Writable data, private to each instance. */
+static int level = -1;
+
+static unsigned
+table_sum (void)
+{
+  unsigned sum = 0;
+  int i;
+
+  for (i = 0; i < TABLE_CNT; i++)
+    sum += table[i] * (i + 1);
+  return sum;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int n = atoi (argv[1]);
+  bool is_root = argc < 3;
+
+  if (is_root)
+    msg ("begin");
+
+  level = n;
+  if (table_sum () != 1 + 2 * TABLE_CNT)
+    fail ("read-only data corrupted at level %d", n);
+
+  if (n > 0)
+    {
+      char child_cmd[128];
+      pid_t child_pid;
+
+      snprintf (child_cmd, sizeof child_cmd, "%s %d child", test_name, n - 1);
+      child_pid = exec (child_cmd);
+      if (child_pid == -1)
+        fail ("exec(\"%s\") failed", child_cmd);
+      if (wait (child_pid) != n - 1)
+        fail ("wait(exec(\"%s\")) returned wrong status", child_cmd);
+    }
+
+  if (level != n)
+    fail ("writable data at level %d changed to %d", n, level);
+
+  if (is_root)
+    msg ("end");
+  return n;
+}
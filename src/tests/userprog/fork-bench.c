@@ -0,0 +1,37 @@
+/* Times fork() by repeating it many times: first forking
+   children that exit at once, then children that exec
+   child-simple.  The kernel's "Timer:" and "Fork:" statistics
+   printed at shutdown give the cost and the number of pages
+   shared and copied. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FORK_CNT 50
+
+void
+test_main (void) 
+{
+  int i;
+
+  for (i = 0; i < FORK_CNT; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (i);
+      if (pid == -1 || wait (pid) != i)
+        fail ("fork+exit %d failed", i);
+    }
+  msg ("%d fork+exit done", FORK_CNT);
+
+  for (i = 0; i < FORK_CNT; i++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        exit (wait (exec ("child-simple")));
+      if (pid == -1 || wait (pid) != 81)
+        fail ("fork+exec %d failed", i);
+    }
+  msg ("%d fork+exec done", FORK_CNT);
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [join ('',
+  "(fork-bench) begin\n",
+  "(fork-bench) 50 fork+exit done\n",
+  "(child-simple) run\n" x 50,
+  "(fork-bench) 50 fork+exec done\n",
+  "(fork-bench) end\n")]);
+pass;
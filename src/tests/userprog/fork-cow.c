@@ -0,0 +1,47 @@
+/* Forks a child that writes to memory it shares copy-on-write
+   with its parent and reads from a file descriptor it inherited.
+   Then checks that the parent's memory and file position were
+   not disturbed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Spans several pages of the data segment. */
+static char buf[3 * 4096] = { 'p' };
+
+void
+test_main (void) 
+{
+  char local[16] = "parent";
+  pid_t pid;
+  char c;
+  int fd;
+  size_t i;
+
+  memset (buf, 'p', sizeof buf);
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      memset (buf, 'c', sizeof buf);
+      strlcpy (local, "child", sizeof local);
+      if (read (fd, &c, 1) != 1 || c != sample[0])
+        exit (-2);
+      exit (81);
+    }
+  if (pid == -1)
+    fail ("fork() failed");
+  msg ("wait(fork()) = %d", wait (pid));
+
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 'p')
+      fail ("parent's data changed at offset %zu", i);
+  if (strcmp (local, "parent"))
+    fail ("parent's stack changed to \"%s\"", local);
+  CHECK (read (fd, &c, 1) == 1 && c == sample[0],
+         "parent's file position unchanged");
+}
@@ -0,0 +1,88 @@
+/* Fork-bomb style exec/wait benchmark, built from multi-oom.
+
+   Every process execs FANOUT copies of itself, one at a time,
+   and waits for each before starting the next, down to DEPTH
+   levels.  Each child reports the size of its subtree as its
+   exit status.  The root rebuilds the whole tree REPETITIONS
+   times, so the run is dominated by exec() and wait(); the
+   kernel's "Timer:" and "Process table:" statistics printed at
+   shutdown give its cost. */
+
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+static const int DEPTH = 4;
+static const int FANOUT = 3;
+static const int REPETITIONS = 5;
+
+const char *test_name = "multi-exec";
+
+/* Returns the number of processes in a full tree of the given
+   DEPTH, including its root. */
+static int
+tree_size (int depth)
+{
+  int size = 1;
+  int level = 1;
+  int i;
+
+  for (i = 0; i < depth; i++)
+    {
+      level *= FANOUT;
+      size += level;
+    }
+  return size;
+}
+
+/* Spawns and reaps the FANOUT children of a process at level N
+   and returns the size of the subtree rooted at it. */
+static int
+spawn_subtree (int n)
+{
+  int size = 1;
+  int i;
+
+  if (n >= DEPTH)
+    return size;
+
+  for (i = 0; i < FANOUT; i++)
+    {
+      char child_cmd[128];
+      pid_t child_pid;
+      int child_size;
+
+      snprintf (child_cmd, sizeof child_cmd, "%s %d", test_name, n + 1);
+      child_pid = exec (child_cmd);
+      if (child_pid == -1)
+        fail ("exec(\"%s\") failed", child_cmd);
+      child_size = wait (child_pid);
+      if (child_size != tree_size (DEPTH - n - 1))
+        fail ("child at level %d reported %d processes, expected %d",
+              n + 1, child_size, tree_size (DEPTH - n - 1));
+      if (wait (child_pid) != -1)
+        fail ("second wait for %d should return -1", child_pid);
+      size += child_size;
+    }
+  return size;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int n = argc > 1 ? atoi (argv[1]) : 0;
+  int i;
+
+  if (n != 0)
+    return spawn_subtree (n);
+
+  msg ("begin");
+  for (i = 0; i < REPETITIONS; i++)
+    if (spawn_subtree (0) != tree_size (DEPTH))
+      fail ("run %d spawned the wrong number of processes", i);
+  msg ("spawned %d processes %d times", tree_size (DEPTH) - 1, REPETITIONS);
+  msg ("end");
+  return 0;
+}
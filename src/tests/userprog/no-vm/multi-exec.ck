@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(multi-exec) begin
+(multi-exec) spawned 120 processes 5 times
+(multi-exec) end
+EOF
+pass;
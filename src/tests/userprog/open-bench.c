@@ -0,0 +1,42 @@
+/* Times open() and close() by repeating them many times, one
+   file at a time and with many files open at once.  The kernel's
+   "Timer:" and "Slab:" statistics printed at shutdown give the
+   cost and the number of objects allocated. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 500
+#define HELD_CNT 32
+
+void
+test_main (void) 
+{
+  int fds[HELD_CNT];
+  int i, j;
+
+  CHECK (create ("bench", 0), "create \"bench\"");
+
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      int fd = open ("bench");
+      if (fd < 2)
+        fail ("open %d failed", i);
+      close (fd);
+    }
+  msg ("%d open+close done", OPEN_CNT);
+
+  for (i = 0; i < OPEN_CNT / HELD_CNT; i++)
+    {
+      for (j = 0; j < HELD_CNT; j++)
+        {
+          fds[j] = open ("bench");
+          if (fds[j] < 2)
+            fail ("open %d of round %d failed", j, i);
+        }
+      for (j = 0; j < HELD_CNT; j++)
+        close (fds[j]);
+    }
+  msg ("%d rounds of %d held open done", OPEN_CNT / HELD_CNT, HELD_CNT);
+}
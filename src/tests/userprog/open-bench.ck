@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-bench) begin
+(open-bench) create "bench"
+(open-bench) 500 open+close done
+(open-bench) 15 rounds of 32 held open done
+(open-bench) end
+EOF
+pass;
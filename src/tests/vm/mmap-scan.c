@@ -0,0 +1,57 @@
+/* Scans a 256 kB file twice, once with read() in 4 kB chunks
+   and once through a memory mapping, and checks that both scans
+   see the same data.  The mapped scan reads each page straight
+   into its frame, without copying through a user buffer. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (256 * 1024)
+#define CHUNK 4096
+#define ACTUAL ((unsigned char *) 0x10000000)
+
+static unsigned char buf[CHUNK];
+
+void
+test_main (void)
+{
+  unsigned long read_sum, mmap_sum;
+  size_t ofs, i;
+  mapid_t map;
+  int handle;
+
+  CHECK (create ("scan", SIZE), "create \"scan\"");
+  CHECK ((handle = open ("scan")) > 1, "open \"scan\"");
+  for (ofs = 0; ofs < SIZE; ofs += CHUNK)
+    {
+      for (i = 0; i < CHUNK; i++)
+        buf[i] = (ofs + i) * 31 / 7;
+      if (write (handle, buf, CHUNK) != CHUNK)
+        fail ("write at offset %zu failed", ofs);
+    }
+
+  msg ("scan with read");
+  read_sum = 0;
+  seek (handle, 0);
+  for (ofs = 0; ofs < SIZE; ofs += CHUNK)
+    {
+      if (read (handle, buf, CHUNK) != CHUNK)
+        fail ("read at offset %zu failed", ofs);
+      for (i = 0; i < CHUNK; i++)
+        read_sum = read_sum * 33 + buf[i];
+    }
+
+  msg ("scan with mmap");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"scan\"");
+  mmap_sum = 0;
+  for (ofs = 0; ofs < SIZE; ofs++)
+    mmap_sum = mmap_sum * 33 + ACTUAL[ofs];
+  munmap (map);
+
+  if (read_sum != mmap_sum)
+    fail ("read scan saw %lx, mmap scan saw %lx", read_sum, mmap_sum);
+  msg ("scans agree");
+  close (handle);
+}
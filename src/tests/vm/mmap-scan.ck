@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-scan) begin
+(mmap-scan) create "scan"
+(mmap-scan) open "scan"
+(mmap-scan) scan with read
+(mmap-scan) scan with mmap
+(mmap-scan) mmap "scan"
+(mmap-scan) scans agree
+(mmap-scan) end
+EOF
+pass;
@@ -0,0 +1,29 @@
+/* Touches one page in every megabyte of a 16 MB array, far more
+   than fits in physical memory.  Only the pages touched may be
+   brought in. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (16 * 1024 * 1024)
+#define STRIDE (1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+
+  msg ("write pass");
+  for (i = 0; i < SIZE; i += STRIDE)
+    buf[i] = i / STRIDE + 1;
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i += STRIDE)
+    if (buf[i] != (char) (i / STRIDE + 1))
+      fail ("byte %zu is %d, expected %d", i, buf[i], (int) (i / STRIDE + 1));
+  for (i = STRIDE / 2; i < SIZE; i += STRIDE)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d, expected 0", i, buf[i]);
+}
@@ -0,0 +1,43 @@
+/* Recurses 1024 levels deep with a 1 kB frame at each level,
+   growing the stack to over 1 MB, and checks that every frame
+   kept its contents.  Then touches only the two ends of a 1 MB
+   stack array, which must not require the pages between them. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DEPTH 1024
+
+static int
+recurse (int depth)
+{
+  char frame[1024];
+  int sum;
+
+  memset (frame, depth & 0xff, sizeof frame);
+  sum = depth < DEPTH ? recurse (depth + 1) : 0;
+  if (frame[0] != (char) (depth & 0xff)
+      || frame[sizeof frame - 1] != (char) (depth & 0xff))
+    fail ("frame at depth %d was corrupted", depth);
+  return sum + depth;
+}
+
+static void
+sparse (void)
+{
+  volatile char big[1024 * 1024];
+
+  big[0] = 1;
+  big[sizeof big - 1] = 2;
+  if (big[0] != 1 || big[sizeof big - 1] != 2)
+    fail ("sparse stack array lost its contents");
+}
+
+void
+test_main (void)
+{
+  msg ("sum: %d", recurse (1));
+  sparse ();
+  msg ("sparse array ok");
+}
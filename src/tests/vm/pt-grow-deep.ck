@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pt-grow-deep) begin
+(pt-grow-deep) sum: 524800
+(pt-grow-deep) sparse array ok
+(pt-grow-deep) end
+EOF
+pass;
@@ -0,0 +1,327 @@
+#include "threads/allocprof.h"
+#ifdef ALLOC_PROFILE
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Profile of the kernel's memory allocations.
+
+   Each live block has an entry in a hash table keyed by its
+   address, which records its size and the call site that
+   allocated it.  Call sites, identified by the return address
+   of the allocator entry point, have entries of their own in a
+   second table, which are never removed.  Both tables use open
+   addressing with linear probing, so that recording a block
+   never has to allocate memory: the profiler sits underneath
+   malloc() and the page allocator and cannot use them itself.
+   The tables are obtained from the page allocator once, at
+   startup.
+
+   Blocks allocated before allocprof_init(), or while the table
+   of live blocks is too full, are counted as untracked and
+   otherwise ignored, as are frees of blocks that are not in the
+   table.
+
+   The page allocator allows freeing part of a block.  The
+   profiler only notices that when the first page is freed, so
+   the pages of a block freed one at a time are all accounted
+   for at that point.
+
+   The profiler is called both from threads and, when the
+   scheduler frees a dying thread's page, with interrupts off,
+   so it disables interrupts rather than taking a lock. */
+
+/* Number of entries in each table. */
+#define LIVE_CNT 4096                   /* Live blocks. */
+#define SITE_CNT 512                    /* Call sites. */
+
+/* Number of call sites listed by peak usage. */
+#define TOP_CNT 10
+
+/* A call site. */
+struct site
+  {
+    void *caller;                       /* Return address, or null. */
+    enum alloc_kind kind;               /* Allocator called. */
+    size_t live_cnt;                    /* Blocks outstanding. */
+    size_t live_bytes;                  /* Bytes outstanding. */
+    size_t peak_bytes;                  /* Largest LIVE_BYTES. */
+    long long alloc_cnt;                /* Blocks ever allocated. */
+  };
+
+/* A live block.  A block from malloc() may start at the same
+   address as the pages it lies in, so blocks are identified by
+   allocator as well as address. */
+struct live
+  {
+    void *block;                        /* Address, or null. */
+    enum alloc_kind kind;               /* Allocator. */
+    size_t size;                        /* Size in bytes. */
+    struct site *site;                  /* Where it was allocated. */
+  };
+
+static struct live *live;
+static struct site *sites;
+static size_t live_used;                /* Entries in use in LIVE. */
+static size_t site_used;                /* Entries in use in SITES. */
+
+/* Statistics. */
+static long long alloc_cnt;
+static long long free_cnt;
+static long long untracked_cnt;
+static size_t live_bytes;
+static size_t peak_bytes;
+
+static struct site *site_lookup (void *caller, enum alloc_kind);
+static struct live *live_lookup (enum alloc_kind, void *block);
+static void live_remove (struct live *);
+static void print_site (const struct site *);
+
+/* Sets up the profiler's tables.  Call right after
+   palloc_init(). */
+void
+allocprof_init (void)
+{
+  size_t live_pages = DIV_ROUND_UP (LIVE_CNT * sizeof *live, PGSIZE);
+  size_t site_pages = DIV_ROUND_UP (SITE_CNT * sizeof *sites, PGSIZE);
+
+  live = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, live_pages);
+  sites = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, site_pages);
+}
+
+/* Records that CALLER allocated BLOCK, which is SIZE bytes long,
+   from allocator KIND.  BLOCK may be null, for a failed
+   allocation. */
+void
+allocprof_alloc (enum alloc_kind kind, void *block, size_t size,
+                 void *caller)
+{
+  enum intr_level old_level;
+  struct site *s;
+  struct live *l;
+
+  if (block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  s = sites != NULL ? site_lookup (caller, kind) : NULL;
+  if (s != NULL && live_used < LIVE_CNT * 3 / 4)
+    l = live_lookup (kind, block);
+  else
+    l = NULL;
+  if (l != NULL)
+    {
+      ASSERT (l->block == NULL);
+      l->block = block;
+      l->kind = kind;
+      l->size = size;
+      l->site = s;
+      live_used++;
+
+      s->alloc_cnt++;
+      s->live_cnt++;
+      s->live_bytes += size;
+      if (s->live_bytes > s->peak_bytes)
+        s->peak_bytes = s->live_bytes;
+      alloc_cnt++;
+      live_bytes += size;
+      if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+    }
+  else
+    untracked_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK, which was allocated earlier from allocator
+   KIND, is now SIZE bytes long. */
+void
+allocprof_resize (enum alloc_kind kind, void *block, size_t size)
+{
+  enum intr_level old_level = intr_disable ();
+  struct live *l = live != NULL ? live_lookup (kind, block) : NULL;
+
+  if (l != NULL && l->block != NULL)
+    {
+      struct site *s = l->site;
+
+      s->live_bytes += size - l->size;
+      if (s->live_bytes > s->peak_bytes)
+        s->peak_bytes = s->live_bytes;
+      live_bytes += size - l->size;
+      if (live_bytes > peak_bytes)
+        peak_bytes = live_bytes;
+      l->size = size;
+    }
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK was freed to allocator KIND. */
+void
+allocprof_free (enum alloc_kind kind, void *block)
+{
+  enum intr_level old_level = intr_disable ();
+  struct live *l = live != NULL ? live_lookup (kind, block) : NULL;
+
+  if (l != NULL && l->block != NULL)
+    {
+      struct site *s = l->site;
+
+      s->live_cnt--;
+      s->live_bytes -= l->size;
+      live_bytes -= l->size;
+      free_cnt++;
+      live_remove (l);
+    }
+  intr_set_level (old_level);
+}
+
+/* qsort() comparison function that orders call sites by
+   decreasing peak usage. */
+static int
+compare_peak (const void *a_, const void *b_)
+{
+  const struct site *a = *(struct site *const *) a_;
+  const struct site *b = *(struct site *const *) b_;
+
+  return (a->peak_bytes < b->peak_bytes) - (a->peak_bytes > b->peak_bytes);
+}
+
+/* qsort() comparison function that orders call sites by
+   decreasing bytes outstanding. */
+static int
+compare_live (const void *a_, const void *b_)
+{
+  const struct site *a = *(struct site *const *) a_;
+  const struct site *b = *(struct site *const *) b_;
+
+  return (a->live_bytes < b->live_bytes) - (a->live_bytes > b->live_bytes);
+}
+
+/* Prints the call sites that used the most memory at their
+   peak, then every call site that still has blocks
+   outstanding. */
+void
+allocprof_print_stats (void)
+{
+  static struct site *order[SITE_CNT];
+  size_t cnt = 0;
+  size_t i;
+
+  if (sites == NULL)
+    return;
+
+  for (i = 0; i < SITE_CNT; i++)
+    if (sites[i].caller != NULL)
+      order[cnt++] = &sites[i];
+
+  printf ("Alloc profile: %lld allocations, %lld frees, %lld untracked, "
+          "%zu bytes in %zu blocks outstanding, %zu bytes peak\n",
+          alloc_cnt, free_cnt, untracked_cnt,
+          live_bytes, live_used, peak_bytes);
+
+  qsort (order, cnt, sizeof *order, compare_peak);
+  printf ("Alloc profile: top call sites by peak usage:\n");
+  for (i = 0; i < cnt && i < TOP_CNT; i++)
+    print_site (order[i]);
+
+  qsort (order, cnt, sizeof *order, compare_live);
+  printf ("Alloc profile: call sites with blocks outstanding:\n");
+  for (i = 0; i < cnt && order[i]->live_cnt > 0; i++)
+    print_site (order[i]);
+  printf ("Alloc profile: the `backtrace' program can turn these "
+          "addresses into function names.\n");
+}
+
+/* Prints call site S. */
+static void
+print_site (const struct site *s)
+{
+  static const char *kind_names[] = {"palloc", "malloc", "slab"};
+
+  printf ("  %p %-6s %8zu bytes peak, %8zu bytes in %5zu blocks live, "
+          "%lld allocated\n",
+          s->caller, kind_names[s->kind], s->peak_bytes,
+          s->live_bytes, s->live_cnt, s->alloc_cnt);
+}
+
+/* Returns the entry for CALLER's call site into allocator KIND,
+   creating it if necessary, or a null pointer if the table of
+   call sites is full.  Interrupts must be off. */
+static struct site *
+site_lookup (void *caller, enum alloc_kind kind)
+{
+  size_t i = hash_bytes (&caller, sizeof caller) % SITE_CNT;
+
+  for (;;)
+    {
+      struct site *s = &sites[i];
+
+      if (s->caller == caller)
+        return s;
+      else if (s->caller == NULL)
+        {
+          if (site_used >= SITE_CNT - 1)
+            return NULL;
+          site_used++;
+          s->caller = caller;
+          s->kind = kind;
+          return s;
+        }
+      i = (i + 1) % SITE_CNT;
+    }
+}
+
+/* Returns the entry for BLOCK from allocator KIND in the table
+   of live blocks, or the empty entry where it would go if it is
+   not there.  Interrupts must be off. */
+static struct live *
+live_lookup (enum alloc_kind kind, void *block)
+{
+  size_t i = hash_bytes (&block, sizeof block) % LIVE_CNT;
+
+  while (live[i].block != NULL
+         && (live[i].block != block || live[i].kind != kind))
+    i = (i + 1) % LIVE_CNT;
+  return &live[i];
+}
+
+/* Removes L from the table of live blocks, moving back the
+   entries after it that would otherwise no longer be found.
+   Interrupts must be off. */
+static void
+live_remove (struct live *l)
+{
+  size_t hole = l - live;
+  size_t i = hole;
+
+  live_used--;
+  for (;;)
+    {
+      size_t home;
+
+      live[hole].block = NULL;
+      do
+        {
+          i = (i + 1) % LIVE_CNT;
+          if (live[i].block == NULL)
+            return;
+          home = (hash_bytes (&live[i].block, sizeof live[i].block)
+                  % LIVE_CNT);
+        }
+      /* Leave the entry at I alone if its home slot lies
+         cyclically in (HOLE, I]. */
+      while (hole <= i
+             ? hole < home && home <= i
+             : hole < home || home <= i);
+      live[hole] = live[i];
+      hole = i;
+    }
+}
+#endif /* ALLOC_PROFILE */
@@ -0,0 +1,48 @@
+#ifndef THREADS_ALLOCPROF_H
+#define THREADS_ALLOCPROF_H
+
+#include <debug.h>
+#include <stddef.h>
+
+/* Allocation profiler.
+
+   A kernel built with "make ALLOC_PROFILE=1" tags every block
+   handed out by the page allocator, malloc(), and the object
+   caches with its size and the address of the code that asked
+   for it.  It keeps live and peak totals for each such call
+   site, and at shutdown prints the biggest consumers and every
+   call site that still has blocks outstanding.  Otherwise all of
+   these functions compile to nothing. */
+
+/* Allocator that a block came from. */
+enum alloc_kind
+  {
+    ALLOC_PALLOC,                       /* Page allocator. */
+    ALLOC_MALLOC,                       /* malloc() and friends. */
+    ALLOC_SLAB                          /* Object caches. */
+  };
+
+/* Return address of the function that uses it, which identifies
+   the call site of an allocator entry point. */
+#define ALLOC_CALLER __builtin_return_address (0)
+
+#ifdef ALLOC_PROFILE
+void allocprof_init (void);
+void allocprof_alloc (enum alloc_kind, void *, size_t, void *caller);
+void allocprof_resize (enum alloc_kind, void *, size_t);
+void allocprof_free (enum alloc_kind, void *);
+void allocprof_print_stats (void);
+#else
+static inline void allocprof_init (void) {}
+static inline void allocprof_alloc (enum alloc_kind kind UNUSED,
+                                    void *block UNUSED, size_t size UNUSED,
+                                    void *caller UNUSED) {}
+static inline void allocprof_resize (enum alloc_kind kind UNUSED,
+                                     void *block UNUSED,
+                                     size_t size UNUSED) {}
+static inline void allocprof_free (enum alloc_kind kind UNUSED,
+                                   void *block UNUSED) {}
+static inline void allocprof_print_stats (void) {}
+#endif
+
+#endif /* threads/allocprof.h */
@@ -15,10 +15,12 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/allocprof.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
@@ -28,19 +30,29 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+#endif
 #else
 #include "tests/threads/tests.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/journal.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* Does the CPU support 4 MB pages, and are they enabled? */
+bool large_pages;
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -54,6 +66,13 @@ static const char *swap_bdev_name;
 #endif
 #endif /* FILESYS */
 
+/* CR4 bit that enables 4 MB pages, and the CPUID feature bit
+   that says it is supported. */
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+#define CPUID_PSE 0x00000008
+#define CPUID_PGE 0x00002000
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
@@ -96,7 +115,9 @@ main (void)
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  allocprof_init ();
   malloc_init ();
+  kmem_init ();
   paging_init ();
 
   /* Segmentation. */
@@ -115,11 +136,17 @@ main (void)
   syscall_init ();
   process_init ();
 #endif
+#ifdef VM
+  frame_init ();
+#endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
   serial_init_queue ();
   timer_calibrate ();
+#ifdef USERPROG
+  palloc_start_zeroing ();
+#endif
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -127,6 +154,9 @@ main (void)
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -135,7 +165,6 @@ main (void)
 
   /* Finish up. */
   shutdown ();
-  process_finish ();
   thread_exit ();
 }
 
@@ -152,16 +181,48 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports FEATURE, one of the
+   CPUID_* bits.  See [IA32-v2a] "CPUID--CPU Identification". */
+static bool
+cpu_has (uint32_t feature)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & feature) != 0;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports them, each whole 4 MB of RAM that holds
+   no kernel code is mapped with a single 4 MB page, which takes
+   one TLB entry instead of 1024.  Kernel code stays on 4 kB
+   pages so that it can be mapped read-only.
+
+   The kernel mapping is the same in every page directory, so if
+   the CPU supports global pages, it is marked global and stays
+   in the TLB when a context switch loads CR3. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool pse = large_pages = cpu_has (CPUID_PSE);
+  bool pge = cpu_has (CPUID_PGE);
+  uint32_t global = pge ? PTE_G : 0;
+
+  if (pse)
+    {
+      /* Enable 4 MB pages.  See [IA32-v3a] 2.5 "Control
+         Registers". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -173,13 +234,21 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (pse && pte_idx == 0 && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (&_end_kernel_text <= vaddr || vaddr + PTSPAN <= &_start))
+        {
+          pd[pde_idx] = pde_create_large_kernel (vaddr, true) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -188,6 +257,15 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  if (pge)
+    {
+      /* Enable global pages only now, so that no stale global
+         entry from the loader's page tables survives. */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE));
+    }
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -249,6 +327,12 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-bc"))
+        cache_sector_cnt = atoi (value);
+      else if (!strcmp (name, "-jsync"))
+        journal_sync = true;
+      else if (!strcmp (name, "-jcrash"))
+        journal_crash = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -261,6 +345,10 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-sl"))
+        stack_page_limit = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -375,6 +463,9 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -bc=COUNT          Cache COUNT sectors of the file system.\n"
+          "  -jsync             Commit each file system operation as it ends.\n"
+          "  -jcrash            Leave the journal unreplayed at power off.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -383,6 +474,9 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -sl=COUNT          Limit user stacks to COUNT pages.\n"
 #endif
           );
   shutdown_power_off ();
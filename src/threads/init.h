@@ -9,4 +9,7 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+/* Does the CPU support 4 MB pages, and are they enabled? */
+extern bool large_pages;
+
 #endif /* threads/init.h */
@@ -5,8 +5,11 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocprof.h"
+#include "threads/loader.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -25,24 +28,46 @@
 
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
-   blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
-
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   blocks, and the descriptor already has ARENA_KEEP such empty
+   arenas, we remove all of the arena's blocks from the free list
+   and give the arena back to the page allocator.  Keeping a few
+   empty arenas around stops a program that repeatedly allocates
+   and frees a single block from creating and destroying an arena
+   each time.
+
+   Each thread also keeps a small "magazine" of free blocks for
+   each small descriptor, which it uses without taking the
+   descriptor's lock.  malloc() takes a block from the magazine
+   if it can, and otherwise refills half of the magazine with one
+   acquisition of the lock.  free() puts the block in the magazine
+   if there is room, and otherwise empties half of the magazine
+   into the free list with one acquisition.  A thread's magazines
+   are emptied when it exits.
+
+   Blocks of 2 kB and up don't fit in a single page with an arena
+   header, so requests from 1 kB to 6 kB go to "medium"
+   descriptors instead, whose arenas span one or more pages
+   obtained together from the page allocator.  Their arena
+   header is itself malloc()'d, and arena_map records the header
+   for each page of a medium arena.  Requests larger than that
+   are handled by allocating contiguous pages with the page
+   allocator and sticking the allocation size at the beginning
+   of the allocated block's arena header. */
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t pages_per_arena;     /* Pages in a medium arena, else 0. */
     struct list free_list;      /* List of free blocks. */
+    size_t empty_cnt;           /* Arenas with no blocks in use. */
     struct lock lock;           /* Lock. */
   };
 
+/* Most empty arenas a descriptor keeps. */
+#define ARENA_KEEP 2
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -52,6 +77,7 @@ struct arena
     unsigned magic;             /* Always set to ARENA_MAGIC. */
     struct desc *desc;          /* Owning descriptor, null for big block. */
     size_t free_cnt;            /* Free blocks; pages in big block. */
+    uint8_t *base;              /* First block. */
   };
 
 /* Free block. */
@@ -60,18 +86,40 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+/* Sizes of the medium descriptors. */
+static const size_t medium_sizes[] = {1536, 2048, 3072, 6144};
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[16];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* For each physical page, the header of the medium arena that
+   the page belongs to, or a null pointer. */
+static struct arena **arena_map;
+
+/* Statistics. */
+static long long magazine_hit_cnt;      /* Lock acquisitions avoided. */
+static long long lock_cnt;              /* Lock acquisitions made. */
+static long long arena_new_cnt;         /* Arenas obtained from palloc. */
+static long long arena_free_cnt;        /* Arenas given back. */
+static long long req_bytes;             /* Bytes requested. */
+static long long alloc_bytes;           /* Bytes handed out for them. */
+static long long realloc_cnt;           /* Calls to realloc(). */
+static long long realloc_inplace_cnt;   /* ...that did not move. */
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get (struct desc *);
+static void desc_put (struct desc *, struct block *);
+static void set_arena_map (struct arena *, struct arena *value);
+static void *allocate (size_t size);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
@@ -79,19 +127,60 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->pages_per_arena = 0;
       list_init (&d->free_list);
+      d->empty_cnt = 0;
       lock_init (&d->lock);
     }
+  ASSERT (desc_cnt == MALLOC_CLASS_CNT);
+
+  /* Give each medium descriptor the smallest arena, up to 8
+     pages, that wastes no more than an eighth of itself. */
+  for (i = 0; i < sizeof medium_sizes / sizeof *medium_sizes; i++)
+    {
+      struct desc *d = &descs[desc_cnt++];
+      size_t page_cnt = 1;
+
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      while (page_cnt < 8
+             && (page_cnt * PGSIZE < medium_sizes[i]
+                 || (page_cnt * PGSIZE % medium_sizes[i]
+                     > page_cnt * PGSIZE / 8)))
+        page_cnt *= 2;
+      d->block_size = medium_sizes[i];
+      d->blocks_per_arena = page_cnt * PGSIZE / medium_sizes[i];
+      d->pages_per_arena = page_cnt;
+      list_init (&d->free_list);
+      d->empty_cnt = 0;
+      lock_init (&d->lock);
+    }
+
+  arena_map = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                   DIV_ROUND_UP (init_ram_pages
+                                                 * sizeof *arena_map,
+                                                 PGSIZE));
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = allocate (size);
+
+  allocprof_alloc (ALLOC_MALLOC, p, size, ALLOC_CALLER);
+  return p;
+}
+
+/* Allocates a block for malloc(), calloc(), or realloc(), which
+   record it with the profiler under their own caller. */
+static void *
+allocate (size_t size)
 {
   struct desc *d;
   struct block *b;
   struct arena *a;
+  struct malloc_magazine *m = NULL;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -116,39 +205,36 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
-      return a + 1;
+      a->base = (uint8_t *) (a + 1);
+      req_bytes += size;
+      alloc_bytes += PGSIZE * page_cnt;
+      return a->base;
     }
+  req_bytes += size;
+  alloc_bytes += d->block_size;
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Use the current thread's magazine, refilling half of it
+     if it is empty. */
+  if (d < descs + MALLOC_CLASS_CNT)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
+      m = &thread_current ()->magazines[d - descs];
+      if (m->cnt > 0)
         {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
+          magazine_hit_cnt++;
+          return m->blocks[--m->cnt];
         }
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  lock_acquire (&d->lock);
+  lock_cnt++;
+  b = desc_get (d);
+  while (b != NULL && m != NULL && m->cnt < MAGAZINE_SIZE / 2)
+    {
+      struct block *extra = desc_get (d);
+      if (extra == NULL)
+        break;
+      m->blocks[m->cnt++] = extra;
+    }
   lock_release (&d->lock);
   return b;
 }
@@ -167,9 +253,10 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = allocate (size);
   if (p != NULL)
     memset (p, 0, size);
+  allocprof_alloc (ALLOC_MALLOC, p, size, ALLOC_CALLER);
 
   return p;
 }
@@ -185,6 +272,53 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the number of bytes that may be used in BLOCK, which
+   must have been allocated with malloc(), calloc(), or
+   realloc().  This is at least the size that was requested, and
+   may be more.  Returns 0 for a null pointer. */
+size_t
+malloc_usable_size (void *block)
+{
+  return block != NULL ? block_size (block) : 0;
+}
+
+/* Tries to resize OLD_BLOCK to NEW_SIZE bytes without moving it,
+   and returns true if successful.  That works if NEW_SIZE still
+   fits OLD_BLOCK's size class well, or, for a big block, if the
+   pages after it are free. */
+static bool
+resize_in_place (void *old_block, size_t new_size)
+{
+  struct arena *a = block_to_arena (old_block);
+  size_t page_cnt;
+
+  if (a->desc != NULL)
+    {
+      /* Keep a block unless it is more than twice the size
+         needed, so that shrinking does not waste memory. */
+      return (new_size <= a->desc->block_size
+              && (new_size > a->desc->block_size / 2 || a->desc == descs));
+    }
+
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (page_cnt < a->free_cnt)
+    {
+      /* Give back the pages at the end. */
+      palloc_free_multiple ((uint8_t *) a + PGSIZE * page_cnt,
+                            a->free_cnt - page_cnt);
+      allocprof_resize (ALLOC_PALLOC, a, PGSIZE * page_cnt);
+      a->free_cnt = page_cnt;
+    }
+  else if (page_cnt > a->free_cnt)
+    {
+      /* Claim the pages that follow, if they are free. */
+      if (!palloc_extend (a, a->free_cnt, page_cnt))
+        return false;
+      a->free_cnt = page_cnt;
+    }
+  return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -199,10 +333,28 @@ realloc (void *old_block, size_t new_size)
       free (old_block);
       return NULL;
     }
+  else if (old_block == NULL)
+    {
+      void *new_block = allocate (new_size);
+
+      allocprof_alloc (ALLOC_MALLOC, new_block, new_size, ALLOC_CALLER);
+      return new_block;
+    }
   else 
     {
-      void *new_block = malloc (new_size);
-      if (old_block != NULL && new_block != NULL)
+      void *new_block;
+
+      realloc_cnt++;
+      if (resize_in_place (old_block, new_size))
+        {
+          realloc_inplace_cnt++;
+          allocprof_resize (ALLOC_MALLOC, old_block, new_size);
+          return old_block;
+        }
+
+      new_block = allocate (new_size);
+      allocprof_alloc (ALLOC_MALLOC, new_block, new_size, ALLOC_CALLER);
+      if (new_block != NULL)
         {
           size_t old_size = block_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
@@ -223,36 +375,42 @@ free (void *p)
       struct block *b = p;
       struct arena *a = block_to_arena (b);
       struct desc *d = a->desc;
-      
+
+      allocprof_free (ALLOC_MALLOC, p);
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct malloc_magazine *m;
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          if (d >= descs + MALLOC_CLASS_CNT)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              /* Medium blocks have no magazine. */
+              lock_acquire (&d->lock);
+              lock_cnt++;
+              desc_put (d, b);
+              lock_release (&d->lock);
+              return;
             }
 
-          lock_release (&d->lock);
+          /* Keep it in the current thread's magazine, first making
+             room by emptying half of it if it is full. */
+          m = &thread_current ()->magazines[d - descs];
+          if (m->cnt < MAGAZINE_SIZE)
+            magazine_hit_cnt++;
+          else
+            {
+              lock_acquire (&d->lock);
+              lock_cnt++;
+              while (m->cnt > MAGAZINE_SIZE / 2)
+                desc_put (d, m->blocks[--m->cnt]);
+              lock_release (&d->lock);
+            }
+          m->blocks[m->cnt++] = b;
         }
       else
         {
@@ -262,12 +420,168 @@ free (void *p)
         }
     }
 }
-
+
+/* Empties the current thread's magazines into their
+   descriptors' free lists.  Called when the thread exits. */
+void
+malloc_thread_exit (void)
+{
+  struct thread *t = thread_current ();
+  size_t i;
+
+  for (i = 0; i < MALLOC_CLASS_CNT; i++)
+    {
+      struct malloc_magazine *m = &t->magazines[i];
+
+      if (m->cnt > 0)
+        {
+          lock_acquire (&descs[i].lock);
+          while (m->cnt > 0)
+            desc_put (&descs[i], m->blocks[--m->cnt]);
+          lock_release (&descs[i].lock);
+        }
+    }
+}
+
+/* Prints malloc() statistics. */
+void
+malloc_print_stats (void)
+{
+  printf ("Malloc: %lld lock acquisitions avoided by magazines, %lld made, "
+          "%lld arenas created, %lld released\n",
+          magazine_hit_cnt, lock_cnt, arena_new_cnt, arena_free_cnt);
+  printf ("Malloc: %lld bytes requested, %lld allocated "
+          "(%lld%% internal fragmentation), "
+          "%lld of %lld reallocs in place\n",
+          req_bytes, alloc_bytes,
+          alloc_bytes > 0 ? (alloc_bytes - req_bytes) * 100 / alloc_bytes : 0,
+          realloc_inplace_cnt, realloc_cnt);
+}
+
+/* Takes a block from D's free list and returns it, creating a
+   new arena if the list is empty.  Returns a null pointer if
+   memory is not available.  D's lock must be held. */
+static struct block *
+desc_get (struct desc *d)
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      if (d->pages_per_arena == 0)
+        {
+          /* Allocate a page. */
+          a = palloc_get_page (0);
+          if (a == NULL)
+            return NULL;
+          a->base = (uint8_t *) (a + 1);
+        }
+      else
+        {
+          /* Allocate the pages and, separately, the header. */
+          a = malloc (sizeof *a);
+          if (a == NULL)
+            return NULL;
+          a->base = palloc_get_multiple (0, d->pages_per_arena);
+          if (a->base == NULL)
+            {
+              free (a);
+              return NULL;
+            }
+        }
+      arena_new_cnt++;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      if (d->pages_per_arena != 0)
+        set_arena_map (a, a);
+      d->empty_cnt++;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Get a block from free list and return it. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  if (a->free_cnt-- == d->blocks_per_arena)
+    d->empty_cnt--;
+  return b;
+}
+
+/* Adds block B to D's free list, giving its arena back to the
+   page allocator if that leaves more than ARENA_KEEP arenas
+   empty.  D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b)
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, keep it or free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      if (d->empty_cnt < ARENA_KEEP)
+        {
+          d->empty_cnt++;
+          return;
+        }
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      if (d->pages_per_arena == 0)
+        palloc_free_page (a);
+      else
+        {
+          set_arena_map (a, NULL);
+          palloc_free_multiple (a->base, d->pages_per_arena);
+          a->magic = 0;
+          free (a);
+        }
+      arena_free_cnt++;
+    }
+}
+
+/* Sets the arena_map entry of each page of medium arena A to
+   VALUE. */
+static void
+set_arena_map (struct arena *a, struct arena *value)
+{
+  size_t page_no = vtop (a->base) >> PGBITS;
+  size_t i;
+
+  for (i = 0; i < a->desc->pages_per_arena; i++)
+    arena_map[page_no + i] = value;
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
 {
-  struct arena *a = pg_round_down (b);
+  struct arena *a = arena_map[vtop (b) >> PGBITS];
+
+  /* Small arenas and big blocks start with their header. */
+  if (a == NULL)
+    a = pg_round_down (b);
 
   /* Check that the arena is valid. */
   ASSERT (a != NULL);
@@ -275,7 +589,7 @@ block_to_arena (struct block *b)
 
   /* Check that the block is properly aligned for the arena. */
   ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+          || ((uint8_t *) b - a->base) % a->desc->block_size == 0);
   ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
 
   return a;
@@ -288,7 +602,5 @@ arena_to_block (struct arena *a, size_t idx)
   ASSERT (a != NULL);
   ASSERT (a->magic == ARENA_MAGIC);
   ASSERT (idx < a->desc->blocks_per_arena);
-  return (struct block *) ((uint8_t *) a
-                           + sizeof *a
-                           + idx * a->desc->block_size);
+  return (struct block *) (a->base + idx * a->desc->block_size);
 }
@@ -4,10 +4,28 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of small malloc() size classes, 16 to 1024 bytes, which
+   have per-thread magazines. */
+#define MALLOC_CLASS_CNT 7
+
+/* Most free blocks a thread keeps for one size class. */
+#define MAGAZINE_SIZE 4
+
+/* A thread's private stock of free blocks of one size class.
+   Only the owning thread touches it, so it needs no lock. */
+struct malloc_magazine
+  {
+    unsigned cnt;                       /* Number of blocks. */
+    void *blocks[MAGAZINE_SIZE];        /* Free blocks. */
+  };
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+size_t malloc_usable_size (void *);
+void malloc_thread_exit (void);
+void malloc_print_stats (void);
 
 #endif /* threads/malloc.h */
@@ -2,13 +2,18 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocprof.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -23,14 +28,61 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory
+   is kept as blocks of 2**ORDER pages, each aligned on its own
+   size in physical memory, on one free list per order.  A
+   request for N pages takes the smallest block of at least N
+   pages, splitting larger blocks in half as needed, and gives
+   back the unused tail at once.  Freeing a block merges it with
+   its "buddy", the other half of the block it was split from,
+   whenever that is free too.  Both take O(log n) time.  The
+   rare request for more pages than the largest block holds is
+   found by scanning the bitmap of used pages for a free run, as
+   the bitmap allocator did for every request.
+
+   The scheduler frees the page of a dying thread with interrupts
+   off, so a pool is protected by turning interrupts off rather
+   than by a lock.  Every operation on the free lists is short.
+
+   Once palloc_start_zeroing() has been called, a low-priority
+   thread zeroes free pages while the CPU would otherwise be idle
+   and keeps them on a short stack in each pool, from which
+   single-page PAL_ZERO requests are served without a memset.
+   Pages on the stack count as allocated, but any request falls
+   back to them when the free lists run out. */
+
+/* Largest block is 2**MAX_ORDER pages, that is, 4 MB. */
+#define MAX_ORDER 10
+
+/* Most pre-zeroed pages kept in one pool. */
+#define ZEROED_MAX 64
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    const char *name;                   /* Name, for statistics. */
+    struct bitmap *used_map;            /* Bitmap of allocated pages. */
     uint8_t *base;                      /* Base of pool. */
+    uint8_t *free_order;                /* Per page: 1 + order of the
+                                           free block it starts, or 0. */
+    struct list free_lists[MAX_ORDER + 1]; /* Free blocks, by order. */
+    size_t free_cnt;                    /* Pages on free lists. */
+    void *zeroed;                       /* Stack of pre-zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages on stack. */
+    size_t zeroed_target;               /* Number to keep on stack. */
+    long long alloc_cnt;                /* Successful allocations. */
+    long long split_cnt;                /* Blocks split in half. */
+    long long merge_cnt;                /* Buddies merged. */
+    long long zero_req_cnt;             /* Single-page PAL_ZERO requests. */
+    long long zero_hit_cnt;             /* ...served from the stack. */
+  };
+
+/* A free block, which holds its own free list element. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -39,6 +91,22 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static int order_for (size_t page_cnt);
+static void *get_multiple (enum palloc_flags, size_t page_cnt);
+static void *take_block (struct pool *, int order);
+static void *take_run (struct pool *, size_t page_cnt);
+static void release_range (struct pool *, uint8_t *pages, size_t page_cnt);
+static void claim_range (struct pool *, uint8_t *pages, size_t page_cnt);
+static void *page_at (struct pool *, size_t page_no);
+static void *pop_zeroed (struct pool *);
+static void wake_zeroer (void);
+static void zeroer (void *aux);
+static void print_pool_stats (struct pool *);
+
+/* Wakes the zeroing thread when a pool runs low. */
+static struct semaphore zero_sema;
+static bool zeroing;
+static bool zero_pending;               /* zero_sema already up? */
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -56,9 +124,9 @@ palloc_init (size_t user_page_limit)
   kernel_pages = free_pages - user_pages;
 
   /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
+  init_pool (&kernel_pool, free_start, kernel_pages, "kernel");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+             user_pages, "user");
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -66,32 +134,66 @@ palloc_init (size_t user_page_limit)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.  A request for more
+   pages than the largest buddy block, 2**MAX_ORDER pages, is
+   satisfied by scanning the pool for a long enough run of free
+   pages instead, which takes time linear in the pool's size. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = get_multiple (flags, page_cnt);
+
+  allocprof_alloc (ALLOC_PALLOC, pages, PGSIZE * page_cnt, ALLOC_CALLER);
+  return pages;
+}
+
+/* Does the work of palloc_get_multiple(), which see. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
-  size_t page_idx;
+  enum intr_level old_level;
+  int order = order_for (page_cnt);
+  uint8_t *pages = NULL;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  old_level = intr_disable ();
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pool->zero_req_cnt++;
+      pages = pop_zeroed (pool);
+      if (pages != NULL)
+        {
+          pool->zero_hit_cnt++;
+          pool->alloc_cnt++;
+          intr_set_level (old_level);
+          return pages;
+        }
+    }
+  if (order > MAX_ORDER)
+    pages = take_run (pool, page_cnt);
+  else if ((pages = take_block (pool, order)) != NULL)
+    {
+      /* Give back the part of the block we don't need. */
+      size_t block_cnt = (size_t) 1 << order;
+      if (page_cnt < block_cnt)
+        release_range (pool, pages + PGSIZE * page_cnt,
+                       block_cnt - page_cnt);
+    }
+  else if (page_cnt == 1)
+    pages = pop_zeroed (pool);
+  if (pages != NULL)
+    pool->alloc_cnt++;
+  intr_set_level (old_level);
 
-  if (pages != NULL) 
+  if (pages != NULL)
     {
       if (flags & PAL_ZERO)
         memset (pages, 0, PGSIZE * page_cnt);
     }
-  else 
+  else
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
@@ -108,17 +210,88 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
-palloc_get_page (enum palloc_flags flags) 
+palloc_get_page (enum palloc_flags flags)
 {
-  return palloc_get_multiple (flags, 1);
+  void *page = get_multiple (flags, 1);
+
+  allocprof_alloc (ALLOC_PALLOC, page, PGSIZE, ALLOC_CALLER);
+  return page;
+}
+
+/* Obtains a 4 MB block of free pages that starts on a 4 MB
+   boundary in physical memory, suitable for mapping with a
+   single large page, and returns its kernel virtual address.
+   FLAGS are as for palloc_get_multiple().  Returns a null
+   pointer if no such block is free.  The pages may be freed one
+   at a time or together. */
+void *
+palloc_get_large (enum palloc_flags flags)
+{
+  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
+  void *pages;
+
+  /* Blocks of the largest order are exactly what we need. */
+  old_level = intr_disable ();
+  pages = take_block (pool, MAX_ORDER);
+  if (pages != NULL)
+    pool->alloc_cnt++;
+  intr_set_level (old_level);
+
+  if (pages != NULL)
+    {
+      ASSERT ((vtop (pages) & ~PDE_LARGE_ADDR) == 0);
+      if (flags & PAL_ZERO)
+        memset (pages, 0, PTSPAN);
+    }
+  else if (flags & PAL_ASSERT)
+    PANIC ("palloc_get_large: out of pages");
+  allocprof_alloc (ALLOC_PALLOC, pages, PTSPAN, ALLOC_CALLER);
+  return pages;
+}
+
+/* Tries to grow the allocation of PAGE_CNT pages at PAGES to
+   NEW_PAGE_CNT pages in place, by claiming the pages that follow
+   it.  Returns true if successful, false if any of those pages
+   is in use or lies outside the pool. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_page_cnt)
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  uint8_t *extra = (uint8_t *) pages + PGSIZE * page_cnt;
+  size_t extra_cnt = new_page_cnt - page_cnt;
+  size_t extra_idx;
+  bool success;
+
+  ASSERT (new_page_cnt >= page_cnt);
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  extra_idx = pg_no (extra) - pg_no (pool->base);
+  if (extra_idx + extra_cnt > bitmap_size (pool->used_map))
+    return false;
+
+  old_level = intr_disable ();
+  success = bitmap_none (pool->used_map, extra_idx, extra_cnt);
+  if (success)
+    claim_range (pool, extra, extra_cnt);
+  intr_set_level (old_level);
+  if (success)
+    allocprof_resize (ALLOC_PALLOC, pages, PGSIZE * new_page_cnt);
+  return success;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
-palloc_free_multiple (void *pages, size_t page_cnt) 
+palloc_free_multiple (void *pages, size_t page_cnt)
 {
   struct pool *pool;
-  size_t page_idx;
+  enum intr_level old_level;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
@@ -131,48 +304,81 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   else
     NOT_REACHED ();
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
-
+  allocprof_free (ALLOC_PALLOC, pages);
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
-  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  old_level = intr_disable ();
+  release_range (pool, pages, page_cnt);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
 void
-palloc_free_page (void *page) 
+palloc_free_page (void *page)
 {
   palloc_free_multiple (page, 1);
 }
 
+/* Starts the thread that keeps each pool stocked with
+   pre-zeroed pages.  Call after thread_start(). */
+void
+palloc_start_zeroing (void)
+{
+  sema_init (&zero_sema, 0);
+  zeroing = true;
+  thread_create ("zeroer", PRI_MIN, zeroer, NULL);
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void)
+{
+  print_pool_stats (&kernel_pool);
+  print_pool_stats (&user_pool);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and free_order array at its
+     base.  Calculate the space needed for them and subtract it
+     from the pool's size. */
+  size_t bm_bytes = ROUND_UP (bitmap_buf_size (page_cnt), sizeof (long));
+  size_t bm_pages = DIV_ROUND_UP (bm_bytes + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
+    PANIC ("Not enough memory in %s pool for bitmap.", name);
   page_cnt -= bm_pages;
 
-  printf ("%zu pages available in %s.\n", page_cnt, name);
+  printf ("%zu pages available in %s pool.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->name = name;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_bytes);
+  p->free_order = (uint8_t *) base + bm_bytes;
   p->base = base + bm_pages * PGSIZE;
+  memset (p->free_order, 0, page_cnt);
+  for (order = 0; order <= MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
+  p->free_cnt = 0;
+  p->zeroed = NULL;
+  p->zeroed_cnt = 0;
+  p->zeroed_target = page_cnt / 16 < ZEROED_MAX ? page_cnt / 16 : ZEROED_MAX;
+
+  /* Put all of it on the free lists. */
+  bitmap_set_all (p->used_map, true);
+  release_range (p, p->base, page_cnt);
 }
 
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
@@ -180,3 +386,315 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the smallest order whose blocks hold at least
+   PAGE_CNT pages. */
+static int
+order_for (size_t page_cnt)
+{
+  int order = 0;
+
+  while (((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
+}
+
+/* Puts the free block of 2**ORDER pages at PAGES on POOL's free
+   list for ORDER, without trying to merge it. */
+static void
+push_block (struct pool *pool, uint8_t *pages, int order)
+{
+  struct free_block *b = (struct free_block *) pages;
+
+  pool->free_order[pg_no (pages) - pg_no (pool->base)] = order + 1;
+  list_push_front (&pool->free_lists[order], &b->elem);
+}
+
+/* Removes free block B, of any order, from POOL's free lists. */
+static void
+remove_block (struct pool *pool, struct free_block *b)
+{
+  pool->free_order[pg_no (b) - pg_no (pool->base)] = 0;
+  list_remove (&b->elem);
+}
+
+/* Removes a block of 2**ORDER pages from POOL's free lists and
+   returns it, splitting a larger block if there is no block of
+   that order, or returns a null pointer if no block is large
+   enough.  Interrupts must be off. */
+static void *
+take_block (struct pool *pool, int order)
+{
+  int k;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (k = order; k <= MAX_ORDER; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      {
+        struct free_block *b = list_entry (list_front (&pool->free_lists[k]),
+                                           struct free_block, elem);
+        uint8_t *pages = (uint8_t *) b;
+        size_t page_cnt = (size_t) 1 << order;
+
+        remove_block (pool, b);
+
+        /* Split it down to size, freeing the upper halves. */
+        while (k > order)
+          {
+            k--;
+            push_block (pool, pages + (PGSIZE << k), k);
+            pool->split_cnt++;
+          }
+
+        pool->free_cnt -= page_cnt;
+        ASSERT (bitmap_none (pool->used_map,
+                             pg_no (pages) - pg_no (pool->base), page_cnt));
+        bitmap_set_multiple (pool->used_map,
+                             pg_no (pages) - pg_no (pool->base),
+                             page_cnt, true);
+        return pages;
+      }
+  return NULL;
+}
+
+/* Takes the first run of PAGE_CNT free pages in POOL, more than
+   the largest block holds, off its free lists and returns it, or
+   returns a null pointer if there is no such run.  Interrupts
+   must be off. */
+static void *
+take_run (struct pool *pool, size_t page_cnt)
+{
+  size_t page_idx;
+  uint8_t *pages;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  page_idx = bitmap_scan (pool->used_map, 0, page_cnt, false);
+  if (page_idx == BITMAP_ERROR)
+    return NULL;
+  pages = pool->base + PGSIZE * page_idx;
+  claim_range (pool, pages, page_cnt);
+  return pages;
+}
+
+/* Frees the block of 2**ORDER pages at PAGES into POOL, merging
+   it with its buddy as long as the buddy is free. */
+static void
+free_block (struct pool *pool, uint8_t *pages, int order)
+{
+  size_t start_page = pg_no (pool->base);
+  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t page_no = pg_no (pages);
+
+  for (; order < MAX_ORDER; order++)
+    {
+      size_t buddy = page_no ^ ((size_t) 1 << order);
+
+      if (buddy < start_page || buddy >= end_page
+          || pool->free_order[buddy - start_page] != order + 1)
+        break;
+      remove_block (pool, page_at (pool, buddy));
+      page_no &= ~((size_t) 1 << order);
+      pool->merge_cnt++;
+    }
+  push_block (pool, page_at (pool, page_no), order);
+}
+
+/* Returns the kernel virtual address of page number PAGE_NO,
+   which must lie in POOL. */
+static void *
+page_at (struct pool *pool, size_t page_no)
+{
+  return pool->base + PGSIZE * (page_no - pg_no (pool->base));
+}
+
+/* Returns the PAGE_CNT allocated pages at PAGES to POOL, as the
+   largest aligned blocks that fit.  Interrupts must be off. */
+static void
+release_range (struct pool *pool, uint8_t *pages, size_t page_cnt)
+{
+  size_t page_idx = pg_no (pages) - pg_no (pool->base);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  pool->free_cnt += page_cnt;
+
+  while (page_cnt > 0)
+    {
+      size_t page_no = pg_no (pages);
+      int order = 0;
+
+      while (order < MAX_ORDER
+             && page_no % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, pages, order);
+      pages += PGSIZE << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Takes the PAGE_CNT free pages at PAGES off POOL's free lists,
+   splitting the free blocks that hold them and giving back the
+   parts of those blocks that lie outside the range.  Interrupts
+   must be off. */
+static void
+claim_range (struct pool *pool, uint8_t *pages, size_t page_cnt)
+{
+  size_t start_page = pg_no (pool->base);
+  size_t page_no = pg_no (pages);
+  size_t end_page = page_no + page_cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (page_no < end_page)
+    {
+      size_t head = page_no, block_cnt = 1, block_end;
+      int order;
+
+      /* Find the free block that holds PAGE_NO. */
+      for (order = 0; order <= MAX_ORDER; order++)
+        {
+          head = page_no & ~(((size_t) 1 << order) - 1);
+          block_cnt = (size_t) 1 << order;
+          if (head >= start_page
+              && pool->free_order[head - start_page] == order + 1)
+            break;
+        }
+      ASSERT (order <= MAX_ORDER);
+      block_end = head + block_cnt;
+
+      /* Take all of it, then give back what lies outside the
+         range. */
+      remove_block (pool, page_at (pool, head));
+      bitmap_set_multiple (pool->used_map, head - start_page, block_cnt,
+                           true);
+      pool->free_cnt -= block_cnt;
+      if (head < page_no)
+        release_range (pool, page_at (pool, head), page_no - head);
+      if (block_end > end_page)
+        release_range (pool, page_at (pool, end_page), block_end - end_page);
+      page_no = block_end < end_page ? block_end : end_page;
+    }
+}
+
+/* Prints statistics for POOL, including how fragmented its free
+   memory is. */
+static void
+print_pool_stats (struct pool *pool)
+{
+  size_t block_cnt = 0;
+  int largest = -1;
+  int order;
+
+  for (order = 0; order <= MAX_ORDER; order++)
+    {
+      size_t n = list_size (&pool->free_lists[order]);
+      block_cnt += n;
+      if (n > 0)
+        largest = order;
+    }
+
+  printf ("Palloc: %s pool: %lld allocations, %lld splits, %lld merges, "
+          "%zu pages free in %zu blocks, largest %zu pages\n",
+          pool->name, pool->alloc_cnt, pool->split_cnt, pool->merge_cnt,
+          pool->free_cnt, block_cnt,
+          largest >= 0 ? (size_t) 1 << largest : 0);
+  printf ("Palloc: %s pool: %lld/%lld zero-page requests served "
+          "pre-zeroed\n",
+          pool->name, pool->zero_hit_cnt, pool->zero_req_cnt);
+}
+
+/* Removes a page from POOL's stack of pre-zeroed pages and
+   returns it, or returns a null pointer if the stack is empty.
+   Wakes the zeroing thread when the stack is empty or below
+   half its target.  Interrupts must be off. */
+static void *
+pop_zeroed (struct pool *pool)
+{
+  void **page = pool->zeroed;
+
+  if (page == NULL)
+    {
+      if (pool->zeroed_target > 0)
+        wake_zeroer ();
+      return NULL;
+    }
+
+  /* The link to the next page is the page's only nonzero word. */
+  pool->zeroed = *page;
+  *page = NULL;
+  if (--pool->zeroed_cnt < pool->zeroed_target / 2)
+    wake_zeroer ();
+  return page;
+}
+
+/* Wakes the zeroing thread to refill the stacks of pre-zeroed
+   pages, unless it has been woken already.  Waking it only when
+   the stack reaches a particular size would miss the wakeup for
+   good once the stack had been drained past that size while the
+   pool had no free pages.
+
+   Only allocation wakes it, never freeing: palloc_free_page()
+   is called from thread_schedule_tail(), where waking a thread
+   could preempt the scheduler itself.  Interrupts must be
+   off. */
+static void
+wake_zeroer (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (zeroing && !zero_pending)
+    {
+      zero_pending = true;
+      sema_up (&zero_sema);
+    }
+}
+
+/* Zeroes free pages of POOL and pushes them on its stack until
+   it holds its target number or the pool has no more free
+   pages. */
+static void
+refill (struct pool *pool)
+{
+  for (;;)
+    {
+      enum intr_level old_level;
+      void **page;
+
+      old_level = intr_disable ();
+      page = (pool->zeroed_cnt < pool->zeroed_target
+              ? take_block (pool, 0)
+              : NULL);
+      intr_set_level (old_level);
+      if (page == NULL)
+        break;
+
+      /* The page is ours now, so it can be zeroed with interrupts
+         on and at leisure. */
+      memset (page, 0, PGSIZE);
+
+      old_level = intr_disable ();
+      *page = pool->zeroed;
+      pool->zeroed = page;
+      pool->zeroed_cnt++;
+      intr_set_level (old_level);
+    }
+}
+
+/* Thread function for the zeroing thread.  Pinned at PRI_MIN,
+   even under the advanced scheduler, it gets the CPU only when
+   no other thread wants it. */
+static void
+zeroer (void *aux UNUSED)
+{
+  thread_set_background ();
+  for (;;)
+    {
+      refill (&kernel_pool);
+      refill (&user_pool);
+      sema_down (&zero_sema);
+      zero_pending = false;
+    }
+}
@@ -66,6 +66,14 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page, 0=page table (PDEs only). */
+#define PTE_G 0x100             /* 1=global, kept in TLB across CR3 loads. */
+
+/* A PDE with PTE_PS set maps a whole 4 MB page, aligned on a 4 MB
+   physical boundary, directly instead of through a page table.
+   Its address bits are the top 10 bits only; its A and D bits
+   work like those of a PTE.  Requires CR4.PSE. */
+#define PDE_LARGE_ADDR 0xffc00000  /* Address bits of a 4 MB page. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -77,9 +85,36 @@ static inline uint32_t pde_create (uint32_t *pt) {
    PDE, which must "present", points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns true if PDE maps a 4 MB page rather than a page
+   table. */
+static inline bool pde_is_large (uint32_t pde) {
+  return (pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS);
+}
+
+/* Returns a PDE that maps the 4 MB page at PAGE, which must be
+   4 MB aligned in physical memory, for ring 0 code only.  If
+   WRITABLE is true then it will be writable as well. */
+static inline uint32_t pde_create_large_kernel (void *page, bool writable) {
+  ASSERT ((vtop (page) & ~PDE_LARGE_ADDR) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
+/* Returns a PDE that maps the 4 MB page at PAGE, usable by both
+   user and kernel code. */
+static inline uint32_t pde_create_large_user (void *page, bool writable) {
+  return pde_create_large_kernel (page, writable) | PTE_U;
+}
+
+/* Returns a pointer to the 4 MB page that PDE maps. */
+static inline void *pde_get_large_page (uint32_t pde) {
+  ASSERT (pde_is_large (pde));
+  return ptov (pde & PDE_LARGE_ADDR);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
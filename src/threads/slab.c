@@ -0,0 +1,280 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/allocprof.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   A kmem_cache hands out objects of one type, carved out of
+   pages called "slabs" that hold nothing but objects of that
+   type.  Compared with malloc(), there is no size class to look
+   up, the cache's lock is not shared with unrelated types, and
+   objects are packed as tightly as their size allows.
+
+   If the cache has a constructor, it runs once for each object,
+   when the object's slab is created, and never again: a freed
+   object keeps its contents and goes back to the cache as is, so
+   the next kmem_cache_alloc() returns it already constructed.
+   The caller must therefore free only objects that are back in
+   their constructed state, for example with their locks
+   released and their lists empty.
+
+   Each slab starts with a header that holds a stack of the
+   indexes of its free objects, so that a free object's contents
+   are never touched.  Slabs with free objects are kept on the
+   cache's partial list, most recently used first.  One slab
+   with no objects in use is kept in reserve; others are given
+   back to the page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Object alignment. */
+#define SLAB_ALIGN sizeof (void *)
+
+/* An object cache. */
+struct kmem_cache
+  {
+    const char *name;                   /* Name, for statistics. */
+    size_t obj_size;                    /* Object size, aligned. */
+    size_t obj_cnt;                     /* Objects per slab. */
+    size_t obj_ofs;                     /* Offset of first object in slab. */
+    void (*ctor) (void *);              /* Constructor, or null. */
+    struct lock lock;                   /* Protects the fields below. */
+    struct list partial;                /* Slabs with free objects. */
+    size_t empty_cnt;                   /* Slabs with no objects in use. */
+    struct list_elem elem;              /* Element in cache_list. */
+
+    /* Statistics. */
+    long long alloc_cnt;                /* Objects allocated. */
+    long long free_cnt;                 /* Objects freed. */
+    long long ctor_cnt;                 /* Constructor calls. */
+    size_t in_use;                      /* Objects allocated, not freed. */
+    size_t peak;                        /* Largest IN_USE. */
+    size_t slab_cnt;                    /* Slabs held. */
+  };
+
+/* A slab.  Occupies the start of its page. */
+struct slab
+  {
+    unsigned magic;                     /* Always SLAB_MAGIC. */
+    struct kmem_cache *cache;           /* Owning cache. */
+    struct list_elem elem;              /* Element in partial list. */
+    size_t free_cnt;                    /* Number of free objects. */
+    uint16_t free[];                    /* Indexes of free objects. */
+  };
+
+/* All caches, for statistics. */
+static struct list cache_list;
+static struct lock cache_list_lock;
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (struct kmem_cache *, void *);
+
+/* Returns the offset of the first object in a slab holding
+   OBJ_CNT objects. */
+static size_t
+obj_offset (size_t obj_cnt)
+{
+  return ROUND_UP (sizeof (struct slab) + obj_cnt * sizeof (uint16_t),
+                   SLAB_ALIGN);
+}
+
+/* Initializes the object cache module. */
+void
+kmem_init (void)
+{
+  list_init (&cache_list);
+  lock_init (&cache_list_lock);
+}
+
+/* Creates and returns a cache for objects of SIZE bytes named
+   NAME.  If CTOR is nonnull, it is called once on each object
+   before it is first handed out.  Panics if memory is not
+   available, because caches are created at boot. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, void (*ctor) (void *))
+{
+  struct kmem_cache *c = malloc (sizeof *c);
+
+  if (c == NULL)
+    PANIC ("out of memory creating %s cache", name);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (size > 0 ? size : 1, SLAB_ALIGN);
+  c->obj_cnt = (PGSIZE - sizeof (struct slab)) / c->obj_size;
+  while (c->obj_cnt > 0
+         && obj_offset (c->obj_cnt) + c->obj_cnt * c->obj_size > PGSIZE)
+    c->obj_cnt--;
+  if (c->obj_cnt == 0)
+    PANIC ("%s objects of %zu bytes do not fit in a slab", name, size);
+  c->obj_ofs = obj_offset (c->obj_cnt);
+  c->ctor = ctor;
+  lock_init (&c->lock);
+  list_init (&c->partial);
+  c->empty_cnt = 0;
+  c->alloc_cnt = c->free_cnt = c->ctor_cnt = 0;
+  c->in_use = c->peak = c->slab_cnt = 0;
+
+  lock_acquire (&cache_list_lock);
+  list_push_back (&cache_list, &c->elem);
+  lock_release (&cache_list_lock);
+  return c;
+}
+
+/* Obtains and returns an object from cache C, or a null pointer
+   if memory is not available.  The object is not zeroed: it is
+   either freshly constructed or as it was last freed. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  size_t idx;
+  void *obj;
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial))
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+    }
+  else
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+
+  if (s->free_cnt == c->obj_cnt)
+    c->empty_cnt--;
+  idx = s->free[--s->free_cnt];
+  if (s->free_cnt == 0)
+    list_remove (&s->elem);
+
+  c->alloc_cnt++;
+  if (++c->in_use > c->peak)
+    c->peak = c->in_use;
+  lock_release (&c->lock);
+
+  obj = (uint8_t *) s + c->obj_ofs + idx * c->obj_size;
+  allocprof_alloc (ALLOC_SLAB, obj, c->obj_size, ALLOC_CALLER);
+  return obj;
+}
+
+/* Returns OBJ, which must have come from cache C, to C. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+  s = obj_to_slab (c, obj);
+  allocprof_free (ALLOC_SLAB, obj);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it must stay constructed. */
+  if (c->ctor == NULL)
+    memset (obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  ASSERT (s->free_cnt < c->obj_cnt);
+  s->free[s->free_cnt++] = ((uint8_t *) obj - (uint8_t *) s - c->obj_ofs)
+                           / c->obj_size;
+  if (s->free_cnt == 1)
+    list_push_front (&c->partial, &s->elem);
+  else
+    {
+      /* Move S to the front, so its objects are reused first. */
+      list_remove (&s->elem);
+      list_push_front (&c->partial, &s->elem);
+    }
+  if (s->free_cnt == c->obj_cnt)
+    {
+      if (c->empty_cnt > 0)
+        {
+          /* One empty slab in reserve is enough. */
+          list_remove (&s->elem);
+          s->magic = 0;
+          palloc_free_page (s);
+          c->slab_cnt--;
+        }
+      else
+        c->empty_cnt++;
+    }
+  c->free_cnt++;
+  c->in_use--;
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      printf ("Slab: %s: %zu-byte objects, %lld allocated, %lld freed, "
+              "%zu in use, %zu peak, %zu slabs, %lld constructed\n",
+              c->name, c->obj_size, c->alloc_cnt, c->free_cnt,
+              c->in_use, c->peak, c->slab_cnt, c->ctor_cnt);
+    }
+}
+
+/* Allocates a new slab for cache C, constructs its objects, and
+   puts it on C's partial list.  Returns the slab, or a null
+   pointer if no page is available.  C's lock must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s = palloc_get_page (0);
+  size_t i;
+
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->obj_cnt;
+  for (i = 0; i < c->obj_cnt; i++)
+    {
+      /* Hand out low addresses first. */
+      s->free[i] = c->obj_cnt - 1 - i;
+      if (c->ctor != NULL)
+        c->ctor ((uint8_t *) s + c->obj_ofs + i * c->obj_size);
+    }
+  if (c->ctor != NULL)
+    c->ctor_cnt += c->obj_cnt;
+
+  list_push_front (&c->partial, &s->elem);
+  c->empty_cnt++;
+  c->slab_cnt++;
+  return s;
+}
+
+/* Returns the slab that holds OBJ, which must have come from
+   cache C. */
+static struct slab *
+obj_to_slab (struct kmem_cache *c, void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == c);
+  ASSERT ((size_t) ((uint8_t *) obj - (uint8_t *) s) >= c->obj_ofs);
+  ASSERT (((uint8_t *) obj - (uint8_t *) s - c->obj_ofs) % c->obj_size == 0);
+  return s;
+}
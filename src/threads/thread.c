@@ -13,7 +13,6 @@
 #include "threads/vaddr.h"
 #ifdef USERPROG
 #include "userprog/process.h"
-#include "userprog/processinfo.h"
 #endif
 
 /* Random value for struct thread's `magic' member.
@@ -247,10 +246,6 @@ thread_create (const char *name, int priority,
     calculate_priority_mlfq (t);
   }
 
-#ifdef USERPROG
-  add_process_info (tid);
-#endif
-
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
   kf->eip = NULL;
@@ -362,6 +357,7 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  malloc_thread_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -472,6 +468,23 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
+/* Makes the current thread run only when no other thread is
+   ready, by pinning its priority at PRI_MIN.  Unlike
+   thread_set_priority(), this also holds under the advanced
+   scheduler, which would otherwise raise the priority of a
+   thread that mostly sleeps. */
+void
+thread_set_background (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+
+  cur->background = true;
+  cur->base_priority = cur->priority = PRI_MIN;
+  thread_yield ();
+  intr_set_level (old_level);
+}
+
 /* Sets the current thread's nice value to NICE. */
 void
 thread_set_nice (int nice UNUSED) 
@@ -611,12 +624,25 @@ init_thread (struct thread *t, const char *name, int priority)
   t->is_userprog = false;
   t->process_name = NULL;
   t->pid = -1;
-  t->pidmap = NULL;
-  t->tidmap = NULL;
+  t->proc = NULL;
+  list_init (&t->children);
   t->exit_status = -1;
   t->fd_base = 2;
   t->fdmap = NULL;
   t->file = NULL;
+  t->image = NULL;
+  t->io_buffer = NULL;
+  t->io_page_cnt = 0;
+#endif
+#ifdef VM
+  t->pages = NULL;
+  t->user_esp = NULL;
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+#endif
+#ifdef FILESYS
+  t->cwd = NULL;
+  t->journal_depth = 0;
 #endif
 
   old_level = intr_disable ();
@@ -844,6 +870,12 @@ calculate_priority (struct thread* t)
 void
 calculate_priority_mlfq (struct thread *t) 
 {
+  if (t->background)
+    {
+      t->priority = PRI_MIN;
+      return;
+    }
+
   /* recent_cpu / 4 */
   fix_p recent_cpu = divide_fix_p_int (t->recent_cpu, 4);
   /* nice * 2 */
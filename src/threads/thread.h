@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixedpoint.h"
+#include "threads/malloc.h"
 #include <hash.h>
 
 /* States in a thread's life cycle. */
@@ -22,6 +23,7 @@ enum thread_status
 typedef int tid_t;
 typedef int pid_t;
 #define TID_ERROR ((tid_t) -1)          /* Error value for tid_t. */
+#define PID_ERROR ((pid_t) -1)          /* Error value for pid_t. */
 
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
@@ -119,6 +121,7 @@ struct thread
     /* Element for advanced Scheduler */
     int nice;                     /* Nice value */
     fix_p recent_cpu;             /* Recent cpu */
+    bool background;              /* Pinned at PRI_MIN, see thread_set_background() */
 
 
 #ifdef USERPROG
@@ -127,15 +130,41 @@ struct thread
     bool is_userprog;                   /* Make diff between kernel and userprog */
     char *process_name;                 /* Name of process, print when exit */
     pid_t pid;                          /* Process identifier */
-    struct hash* tidmap;                /* Save all child's tid */
-    struct hash* pidmap;                /* Save exec success child's pid */
+    struct process_info *proc;          /* Own slot in process table */
+    struct list children;               /* Slots of children not waited */
     int exit_status;                    /* Exit status */
     int fd_base;                        /* Allocate different file id */
     struct hash* fdmap;                 /* Map from fd to file pointer */
     struct file* file;                  /* Deni writing */
-    
+    struct image *image;                /* Cached image of executable */
+
+    /* Owned by userprog/syscall.c. */
+    void *io_buffer;                    /* Buffer of a read or write... */
+    size_t io_page_cnt;                 /* ...in progress, and its size. */
+#endif
+
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash *pages;                 /* Supplemental page table. */
+    void *user_esp;                     /* User esp on syscall entry. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Allocate mapping ids. */
 #endif
 
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Current directory, or null
+                                           for the root. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Journal operations begun. */
+#endif
+
+    /* Owned by threads/malloc.c. */
+    struct malloc_magazine magazines[MALLOC_CLASS_CNT];
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -170,6 +199,7 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_set_background (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
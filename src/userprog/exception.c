@@ -2,8 +2,13 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -148,9 +153,32 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+  struct thread *t = thread_current ();
+#ifdef VM
+  /* Bring in a page the process registered but never touched,
+     or grow the stack down to FAULT_ADDR.  In kernel context,
+     the user stack pointer is the one saved on entry to the
+     system call. */
+  if (not_present
+      && (page_in (fault_addr)
+          || page_grow_stack (fault_addr, user ? f->esp : t->user_esp)))
+    return;
+#endif
+
+  /* A write to a page shared with a forked relative gets its
+     own copy.  This happens for the kernel too, when a system
+     call writes into a user buffer. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && t->pagedir != NULL
+      && pagedir_cow_fault (t->pagedir, pg_round_down (fault_addr)))
+    return;
+
+  /* Any other fault on a user address in kernel context comes
+     from a system call touching a bad user buffer.  Kill the
+     process rather than the kernel. */
+  if (!user && is_user_vaddr (fault_addr) && t->pagedir != NULL)
+    thread_exit ();
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
@@ -1,8 +1,8 @@
 #include <hash.h>
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
-#include "userprog/process.h"
 #include "userprog/fdmap.h"
 
 
@@ -15,6 +15,19 @@ struct fdmap_entry
 
 static struct hash* fdmap_create (void);
 
+/* Cache of fdmap entries */
+static struct kmem_cache *fdmap_entry_cache;
+
+/*
+  Called in process_init ()
+*/
+void
+fdmap_init (void)
+{
+  fdmap_entry_cache = kmem_cache_create ("fdmap_entry",
+                                         sizeof (struct fdmap_entry), NULL);
+}
+
 /* Hash funcition */
 static unsigned
 fdmap_entry_hash (const struct hash_elem *p_, void *aux UNUSED)
@@ -43,7 +56,7 @@ hash_free_func (struct hash_elem *element, void *aux UNUSED)
 {
   struct fdmap_entry *entry = hash_entry (element, struct fdmap_entry, helem);
   file_close (entry->file);
-  free (entry);
+  kmem_cache_free (fdmap_entry_cache, entry);
 }
 
 /* 
@@ -64,7 +77,7 @@ struct hash*
 fdmap_add (struct hash* fdmap, int fd, struct file* file_)
 {
   if (fdmap == NULL) fdmap = fdmap_create ();
-  struct fdmap_entry *entry = malloc (sizeof (struct fdmap_entry));
+  struct fdmap_entry *entry = kmem_cache_alloc (fdmap_entry_cache);
   entry->fd = fd;
   entry->file = file_;
   hash_insert (fdmap, &entry->helem);
@@ -104,14 +117,40 @@ fdmap_remove (struct hash* fdmap, int fd)
 	{
 		struct fdmap_entry *value = hash_entry (value_, struct fdmap_entry, helem);
 
-		filesys_lock_acquire ();
 		file_close (value->file);
-		filesys_lock_release ();
 		
-		free (value);
+		kmem_cache_free (fdmap_entry_cache, value);
 	}
 }
 
+/*
+  Called in process_fork ()
+  Copy every (fd, file*) of SRC into a new map stored in *DST,
+  reopening each file at the same position.
+  Return false if memory runs out; *DST then holds what was
+  copied so far.
+*/
+bool
+fdmap_duplicate (struct hash* src, struct hash** dst)
+{
+  struct hash_iterator i;
+
+  *dst = NULL;
+  if (src == NULL) return true;
+
+  hash_first (&i, src);
+  while (hash_next (&i))
+  {
+    struct fdmap_entry *entry = hash_entry (hash_cur (&i), struct fdmap_entry, helem);
+    struct file *file = file_reopen (entry->file);
+    if (file == NULL)
+      return false;
+    file_seek (file, file_tell (entry->file));
+    *dst = fdmap_add (*dst, entry->fd, file);
+  }
+  return true;
+}
+
 /*
   Called in thread_exit()
   free every element in hash map and free map itself
@@ -121,9 +160,7 @@ fdmap_destroy (struct hash* fdmap)
 {
 	if (fdmap == NULL) return;
 
-	filesys_lock_acquire ();
 	hash_destroy (fdmap, hash_free_func);
-	filesys_lock_release ();
 
 	free (fdmap);
 }
@@ -1,9 +1,11 @@
 #ifndef _FDMAP_
 #define _FDMAP_
 
+void fdmap_init (void);
 struct hash* fdmap_add (struct hash* fdmap, int fd, struct file* file_);
 struct file* fdmap_get (struct hash* fdmap, int fd);
 void fdmap_remove (struct hash* fdmap, int fd);
+bool fdmap_duplicate (struct hash* src, struct hash** dst);
 void fdmap_destroy (struct hash* fdmap);
 
 #endif
\ No newline at end of file
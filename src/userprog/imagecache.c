@@ -0,0 +1,538 @@
+#include "userprog/imagecache.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Executable image cache.
+
+   Running the same program many times used to re-read and
+   re-parse its ELF headers and copy every page of every segment
+   out of the file on each exec.  Here we keep, per executable
+   inode, the parsed segment list and the frames of its
+   read-only segments.  New processes map those frames shared
+   (see pagedir_set_shared_page()), so their text costs neither
+   I/O nor memory.  Writable segments are still copied per
+   process.
+
+   An image stays cached after its last process exits, until it
+   is evicted to make room or invalidated because its file was
+   written or removed. */
+
+/* Maximum number of frames held by cached read-only segments. */
+#define IMAGECACHE_MAX_PAGES 128
+
+/* We load ELF binaries.  The following definitions are taken
+   from the ELF specification, [ELF1], more-or-less verbatim.  */
+
+/* ELF types.  See [ELF1] 1-2. */
+typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
+typedef uint16_t Elf32_Half;
+
+/* For use with ELF types in printf(). */
+#define PE32Wx PRIx32   /* Print Elf32_Word in hexadecimal. */
+#define PE32Ax PRIx32   /* Print Elf32_Addr in hexadecimal. */
+#define PE32Ox PRIx32   /* Print Elf32_Off in hexadecimal. */
+#define PE32Hx PRIx16   /* Print Elf32_Half in hexadecimal. */
+
+/* Executable header.  See [ELF1] 1-4 to 1-8.
+   This appears at the very beginning of an ELF binary. */
+struct Elf32_Ehdr
+  {
+    unsigned char e_ident[16];
+    Elf32_Half    e_type;
+    Elf32_Half    e_machine;
+    Elf32_Word    e_version;
+    Elf32_Addr    e_entry;
+    Elf32_Off     e_phoff;
+    Elf32_Off     e_shoff;
+    Elf32_Word    e_flags;
+    Elf32_Half    e_ehsize;
+    Elf32_Half    e_phentsize;
+    Elf32_Half    e_phnum;
+    Elf32_Half    e_shentsize;
+    Elf32_Half    e_shnum;
+    Elf32_Half    e_shstrndx;
+  };
+
+/* Program header.  See [ELF1] 2-2 to 2-4.
+   There are e_phnum of these, starting at file offset e_phoff
+   (see [ELF1] 1-6). */
+struct Elf32_Phdr
+  {
+    Elf32_Word p_type;
+    Elf32_Off  p_offset;
+    Elf32_Addr p_vaddr;
+    Elf32_Addr p_paddr;
+    Elf32_Word p_filesz;
+    Elf32_Word p_memsz;
+    Elf32_Word p_flags;
+    Elf32_Word p_align;
+  };
+
+/* Values for p_type.  See [ELF1] 2-3. */
+#define PT_NULL    0            /* Ignore. */
+#define PT_LOAD    1            /* Loadable segment. */
+#define PT_DYNAMIC 2            /* Dynamic linking info. */
+#define PT_INTERP  3            /* Name of dynamic loader. */
+#define PT_NOTE    4            /* Auxiliary info. */
+#define PT_SHLIB   5            /* Reserved. */
+#define PT_PHDR    6            /* Program header table. */
+#define PT_STACK   0x6474e551   /* Stack segment. */
+
+/* Flags for p_flags.  See [ELF3] 2-3 and 2-4. */
+#define PF_X 1          /* Executable. */
+#define PF_W 2          /* Writable. */
+#define PF_R 4          /* Readable. */
+
+/* Marks a slot in an image_segment's kpages[] whose page is
+   being read in. */
+#define KPAGE_LOADING ((void *) 1)
+
+/* Cached images, by inode sector. */
+static struct hash images;
+
+/* Cached images no process is running, least recently used
+   first. */
+static struct list lru_images;
+
+/* Protects everything above and the frames of every image.  It
+   is not held while a page is read from disk. */
+static struct lock imagecache_lock;
+
+/* Frames currently held by cached read-only segments. */
+static size_t cached_pages;
+
+/* Statistics. */
+static long long hit_cnt;
+static long long miss_cnt;
+static long long shared_map_cnt;
+static long long evict_cnt;
+
+static struct image *parse_image (struct file *);
+static bool validate_segment (const struct Elf32_Phdr *, struct file *);
+static void free_image (struct image *);
+static bool evict_one (void);
+
+/* Hash function */
+static unsigned
+image_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct image *image = hash_entry (e, struct image, helem);
+  return hash_int (image->sector);
+}
+
+/* Hash function */
+static bool
+image_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct image *a = hash_entry (a_, struct image, helem);
+  const struct image *b = hash_entry (b_, struct image, helem);
+  return a->sector < b->sector;
+}
+
+/* Initializes the image cache. */
+void
+imagecache_init (void)
+{
+  hash_init (&images, image_hash, image_less, NULL);
+  list_init (&lru_images);
+  lock_init (&imagecache_lock);
+  inode_set_change_hook (imagecache_invalidate);
+}
+
+/* Returns the parsed image of executable FILE with a reference
+   held for the calling process, parsing the file's headers only
+   if it is not cached yet.  Returns a null pointer if FILE is
+   not a valid executable or memory is short. */
+struct image *
+imagecache_get (struct file *file)
+{
+  block_sector_t sector = inode_get_inumber (file_get_inode (file));
+  struct image key, *image;
+  struct hash_elem *e;
+
+  lock_acquire (&imagecache_lock);
+  key.sector = sector;
+  e = hash_find (&images, &key.helem);
+  if (e != NULL)
+    {
+      image = hash_entry (e, struct image, helem);
+      if (image->refs++ == 0)
+        list_remove (&image->lru_elem);
+      hit_cnt++;
+      lock_release (&imagecache_lock);
+      return image;
+    }
+  miss_cnt++;
+  lock_release (&imagecache_lock);
+
+  image = parse_image (file);
+  if (image == NULL)
+    return NULL;
+  image->sector = sector;
+  image->refs = 1;
+
+  /* Another process may have cached the same file meanwhile.
+     Keep our copy private in that case.  A cached image must
+     hear when its file changes. */
+  lock_acquire (&imagecache_lock);
+  image->cached = hash_insert (&images, &image->helem) == NULL;
+  lock_release (&imagecache_lock);
+  if (image->cached)
+    inode_watch (file_get_inode (file));
+  return image;
+}
+
+/* Takes another reference to IMAGE, for a process forked from
+   one running it.  Returns IMAGE. */
+struct image *
+imagecache_dup (struct image *image)
+{
+  if (image != NULL)
+    {
+      lock_acquire (&imagecache_lock);
+      ASSERT (image->refs > 0);
+      image->refs++;
+      lock_release (&imagecache_lock);
+    }
+  return image;
+}
+
+/* Drops the calling process's reference to IMAGE.  The image
+   stays cached for later execs unless it was invalidated. */
+void
+imagecache_put (struct image *image)
+{
+  if (image == NULL)
+    return;
+
+  lock_acquire (&imagecache_lock);
+  ASSERT (image->refs > 0);
+  if (--image->refs == 0)
+    {
+      if (image->cached)
+        list_push_back (&lru_images, &image->lru_elem);
+      else
+        free_image (image);
+    }
+  lock_release (&imagecache_lock);
+}
+
+/* Returns the shared frame that holds page PAGE_IDX of
+   read-only segment SEG of IMAGE, reading it from FILE the first
+   time it is needed.  Returns a null pointer if the cache is
+   full or out of memory; the caller then loads a private copy
+   of the page instead.  The calling process must hold a
+   reference to IMAGE.
+
+   The page is read without holding the cache lock, so that
+   other execs, faults and invalidations go on meanwhile.  Its
+   slot is marked KPAGE_LOADING until then, and a process that
+   faults on the same page waits for the read to finish. */
+void *
+imagecache_page (struct image *image, struct image_segment *seg,
+                 size_t page_idx, struct file *file)
+{
+  size_t page_read_bytes;
+  off_t ofs;
+  void *kpage;
+
+  ASSERT (!seg->writable);
+
+  if (!image->cached || seg->kpages == NULL)
+    return NULL;
+
+  lock_acquire (&imagecache_lock);
+  while ((kpage = seg->kpages[page_idx]) == KPAGE_LOADING)
+    cond_wait (&image->page_loaded, &imagecache_lock);
+  if (kpage == NULL)
+    {
+      while (cached_pages >= IMAGECACHE_MAX_PAGES && evict_one ())
+        continue;
+      if (cached_pages < IMAGECACHE_MAX_PAGES)
+        {
+          kpage = palloc_get_page (PAL_USER);
+          if (kpage == NULL && evict_one ())
+            kpage = palloc_get_page (PAL_USER);
+        }
+      if (kpage != NULL)
+        {
+          /* Claim the slot and read the page unlocked.  Our
+             reference keeps IMAGE from being freed meanwhile. */
+          seg->kpages[page_idx] = KPAGE_LOADING;
+          cached_pages++;
+          lock_release (&imagecache_lock);
+
+          ofs = page_idx * PGSIZE;
+          page_read_bytes = 0;
+          if (seg->read_bytes > (uint32_t) ofs)
+            page_read_bytes = seg->read_bytes - ofs < PGSIZE
+                              ? seg->read_bytes - ofs : PGSIZE;
+          if (file_read_at (file, kpage, page_read_bytes,
+                            seg->file_page + ofs) != (int) page_read_bytes)
+            {
+              palloc_free_page (kpage);
+              kpage = NULL;
+            }
+          else
+            memset ((uint8_t *) kpage + page_read_bytes, 0,
+                    PGSIZE - page_read_bytes);
+
+          lock_acquire (&imagecache_lock);
+          seg->kpages[page_idx] = kpage;
+          if (kpage == NULL)
+            cached_pages--;
+          cond_broadcast (&image->page_loaded, &imagecache_lock);
+        }
+    }
+  if (kpage != NULL)
+    shared_map_cnt++;
+  lock_release (&imagecache_lock);
+  return kpage;
+}
+
+/* Drops the cached image of the file whose inode lives at
+   SECTOR, if any.  Called through the inode change hook when
+   that file is written or removed, or its inode leaves memory.
+   Processes still running the image keep it until they exit. */
+void
+imagecache_invalidate (block_sector_t sector)
+{
+  struct image key, *image;
+  struct hash_elem *e;
+
+  lock_acquire (&imagecache_lock);
+  key.sector = sector;
+  e = hash_delete (&images, &key.helem);
+  if (e != NULL)
+    {
+      image = hash_entry (e, struct image, helem);
+      image->cached = false;
+      if (image->refs == 0)
+        {
+          list_remove (&image->lru_elem);
+          free_image (image);
+        }
+    }
+  lock_release (&imagecache_lock);
+}
+
+/* Evicts one image that no process is running, to give its
+   frames back to the user pool.  Returns true if an image was
+   evicted, false if there was nothing to evict. */
+bool
+imagecache_shrink (void)
+{
+  bool success;
+
+  lock_acquire (&imagecache_lock);
+  success = evict_one ();
+  lock_release (&imagecache_lock);
+  return success;
+}
+
+/* Prints image cache statistics. */
+void
+imagecache_print_stats (void)
+{
+  printf ("Image cache: %lld hits, %lld misses, %lld shared pages mapped, "
+          "%zu pages cached, %lld evictions\n",
+          hit_cnt, miss_cnt, shared_map_cnt, cached_pages, evict_cnt);
+}
+
+/* Evicts the least recently used unused image.
+   Must be called with imagecache_lock held. */
+static bool
+evict_one (void)
+{
+  struct image *image;
+
+  ASSERT (lock_held_by_current_thread (&imagecache_lock));
+
+  if (list_empty (&lru_images))
+    return false;
+  image = list_entry (list_pop_front (&lru_images), struct image, lru_elem);
+  hash_delete (&images, &image->helem);
+  free_image (image);
+  evict_cnt++;
+  return true;
+}
+
+/* Frees IMAGE and every frame it holds. */
+static void
+free_image (struct image *image)
+{
+  int i;
+
+  for (i = 0; i < image->segment_cnt; i++)
+    {
+      struct image_segment *seg = &image->segments[i];
+      if (seg->kpages != NULL)
+        {
+          size_t page_cnt = (seg->read_bytes + seg->zero_bytes) / PGSIZE;
+          size_t j;
+
+          for (j = 0; j < page_cnt; j++)
+            if (seg->kpages[j] != NULL)
+              {
+                ASSERT (seg->kpages[j] != KPAGE_LOADING);
+                palloc_free_page (seg->kpages[j]);
+                cached_pages--;
+              }
+          free (seg->kpages);
+        }
+    }
+  free (image->segments);
+  free (image);
+}
+
+/* Reads and verifies the ELF header and program headers of FILE
+   and returns a new, uncached image describing them, or a null
+   pointer on failure. */
+static struct image *
+parse_image (struct file *file)
+{
+  struct Elf32_Ehdr ehdr;
+  struct image *image;
+  off_t file_ofs;
+  int i;
+
+  /* Read and verify executable header. */
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
+      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
+      || ehdr.e_type != 2
+      || ehdr.e_machine != 3
+      || ehdr.e_version != 1
+      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
+      || ehdr.e_phnum > 1024)
+    return NULL;
+
+  image = calloc (1, sizeof *image);
+  if (image == NULL)
+    return NULL;
+  cond_init (&image->page_loaded);
+  image->entry = ehdr.e_entry;
+  image->segments = calloc (ehdr.e_phnum, sizeof *image->segments);
+  if (image->segments == NULL && ehdr.e_phnum > 0)
+    goto fail;
+
+  /* Read program headers. */
+  file_ofs = ehdr.e_phoff;
+  for (i = 0; i < ehdr.e_phnum; i++)
+    {
+      struct Elf32_Phdr phdr;
+      struct image_segment *seg;
+      uint32_t page_offset;
+
+      if (file_ofs < 0 || file_ofs > file_length (file))
+        goto fail;
+      if (file_read_at (file, &phdr, sizeof phdr, file_ofs) != sizeof phdr)
+        goto fail;
+      file_ofs += sizeof phdr;
+      switch (phdr.p_type)
+        {
+        case PT_NULL:
+        case PT_NOTE:
+        case PT_PHDR:
+        case PT_STACK:
+        default:
+          /* Ignore this segment. */
+          break;
+        case PT_DYNAMIC:
+        case PT_INTERP:
+        case PT_SHLIB:
+          goto fail;
+        case PT_LOAD:
+          if (!validate_segment (&phdr, file))
+            goto fail;
+
+          seg = &image->segments[image->segment_cnt++];
+          seg->writable = (phdr.p_flags & PF_W) != 0;
+          seg->file_page = phdr.p_offset & ~PGMASK;
+          seg->upage = (uint8_t *) (phdr.p_vaddr & ~PGMASK);
+          page_offset = phdr.p_vaddr & PGMASK;
+          if (phdr.p_filesz > 0)
+            {
+              /* Normal segment.
+                 Read initial part from disk and zero the rest. */
+              seg->read_bytes = page_offset + phdr.p_filesz;
+              seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+                                 - seg->read_bytes);
+            }
+          else
+            {
+              /* Entirely zero.
+                 Don't read anything from disk. */
+              seg->read_bytes = 0;
+              seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
+            }
+
+          /* Read-only segments get a slot per page for their
+             shared frames.  Without one the segment is simply
+             loaded privately. */
+          if (!seg->writable)
+            seg->kpages = calloc ((seg->read_bytes + seg->zero_bytes) / PGSIZE,
+                                  sizeof *seg->kpages);
+          break;
+        }
+    }
+  return image;
+
+ fail:
+  free_image (image);
+  return NULL;
+}
+
+/* Checks whether PHDR describes a valid, loadable segment in
+   FILE and returns true if so, false otherwise. */
+static bool
+validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
+{
+  /* p_offset and p_vaddr must have the same page offset. */
+  if ((phdr->p_offset & PGMASK) != (phdr->p_vaddr & PGMASK))
+    return false;
+
+  /* p_offset must point within FILE. */
+  if (phdr->p_offset > (Elf32_Off) file_length (file))
+    return false;
+
+  /* p_memsz must be at least as big as p_filesz. */
+  if (phdr->p_memsz < phdr->p_filesz)
+    return false;
+
+  /* The segment must not be empty. */
+  if (phdr->p_memsz == 0)
+    return false;
+
+  /* The virtual memory region must both start and end within the
+     user address space range. */
+  if (!is_user_vaddr ((void *) phdr->p_vaddr))
+    return false;
+  if (!is_user_vaddr ((void *) (phdr->p_vaddr + phdr->p_memsz)))
+    return false;
+
+  /* The region cannot "wrap around" across the kernel virtual
+     address space. */
+  if (phdr->p_vaddr + phdr->p_memsz < phdr->p_vaddr)
+    return false;
+
+  /* Disallow mapping page 0.
+     Not only is it a bad idea to map page 0, but if we allowed
+     it then user code that passed a null pointer to system calls
+     could quite likely panic the kernel by way of null pointer
+     assertions in memcpy(), etc. */
+  if (phdr->p_vaddr < PGSIZE)
+    return false;
+
+  /* It's okay. */
+  return true;
+}
@@ -0,0 +1,50 @@
+#ifndef USERPROG_IMAGECACHE_H
+#define USERPROG_IMAGECACHE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct file;
+
+/* One loadable segment of an executable, already validated and
+   rounded to whole pages. */
+struct image_segment
+  {
+    off_t file_page;                    /* File offset of first page. */
+    uint8_t *upage;                     /* User address of first page. */
+    uint32_t read_bytes;                /* Bytes to read from the file. */
+    uint32_t zero_bytes;                /* Bytes to zero after them. */
+    bool writable;                      /* Writable segment? */
+    void **kpages;                      /* Shared frames, read-only only. */
+  };
+
+/* A parsed executable, keyed by the sector of its inode. */
+struct image
+  {
+    block_sector_t sector;              /* Inode sector of the file. */
+    uint32_t entry;                     /* Entry point. */
+    int segment_cnt;                    /* Number of segments. */
+    struct image_segment *segments;     /* Loadable segments. */
+    int refs;                           /* Processes running the image. */
+    bool cached;                        /* Still reachable from cache? */
+    struct condition page_loaded;       /* Signaled when a page is read. */
+    struct hash_elem helem;             /* Element in image hash. */
+    struct list_elem lru_elem;          /* Element in LRU list. */
+  };
+
+void imagecache_init (void);
+struct image *imagecache_get (struct file *);
+struct image *imagecache_dup (struct image *);
+void imagecache_put (struct image *);
+void *imagecache_page (struct image *, struct image_segment *,
+                       size_t page_idx, struct file *);
+void imagecache_invalidate (block_sector_t);
+bool imagecache_shrink (void);
+void imagecache_print_stats (void);
+
+#endif /* userprog/imagecache.h */
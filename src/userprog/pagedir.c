@@ -1,13 +1,66 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
+
+/* PTE bits, from the bits available for OS use.
+
+   PTE_SHARED marks a frame that PD maps but does not own, such
+   as a page of an executable shared through the image cache.
+   pagedir_destroy() leaves such frames alone.
+
+   PTE_REF marks a frame that may be mapped by several page
+   directories after fork().  Its extra mappings are counted in
+   frame_refs[], and the last page directory to let go of it
+   frees it.
+
+   PTE_COW marks a PTE_REF page that the process may write.  It
+   is mapped read-only, and the first write to it takes a
+   private copy in pagedir_cow_fault(). */
+#define PTE_SHARED 0x200
+#define PTE_REF    0x400
+#define PTE_COW    0x800
+
+/* For each physical frame, the number of page directories
+   beyond the first that map it with PTE_REF. */
+static uint16_t *frame_refs;
+
+/* Copy-on-write statistics. */
+static long long fork_cnt;
+static long long cow_shared_cnt;
+static long long cow_copy_cnt;
+static long long cow_reuse_cnt;
+static long long large_split_cnt;
+static long long cr3_load_cnt;
+static long long cr3_skip_cnt;
+static long long invlpg_cnt;
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static uint32_t *lookup_page (uint32_t *pd, const void *vaddr, bool create);
+static void invalidate_page (uint32_t *, const void *);
+static void frame_ref (void *kpage);
+static bool frame_unref (void *kpage);
+static void release_frame (uint32_t *pd, uint32_t pte);
+static bool split_large_page (uint32_t *pde);
+
+/* Sets up the reference counts used to share frames between
+   forked processes. */
+void
+pagedir_init (void)
+{
+  frame_refs = calloc (init_ram_pages, sizeof *frame_refs);
+  if (frame_refs == NULL)
+    PANIC ("could not allocate frame reference counts");
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -34,25 +87,197 @@ pagedir_destroy (uint32_t *pd)
 
   ASSERT (pd != init_page_dir);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
+    if (pde_is_large (*pde))
+      palloc_free_multiple (pde_get_large_page (*pde), PTSPAN / PGSIZE);
+    else if (*pde & PTE_P) 
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
+          if (*pte & PTE_P)
+            release_frame (pd, *pte);
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
 }
 
+/* Creates a copy of page directory PARENT for a forked child.
+   Every private user page ends up mapped by both page
+   directories.  Pages either process may write are made
+   read-only in both and are copied on the first write; see
+   pagedir_cow_fault().  Returns the new page directory, or a
+   null pointer if memory allocation fails.
+
+   The caller must make sure PARENT's process does not run, and
+   that its stale TLB entries are flushed before it does.  With
+   virtual memory, it must also hold the frame table lock, so
+   that none of PARENT's pages are evicted meanwhile, and keep
+   holding it until page_table_copy() has registered the child
+   with the frames it now shares.
+
+   4 MB pages in PARENT are split into 4 kB pages first, so that
+   each can be copied on its own. */
+uint32_t *
+pagedir_fork (uint32_t *parent) 
+{
+  uint32_t *pd = pagedir_create ();
+  uint32_t *pde;
+
+  if (pd == NULL)
+    return NULL;
+
+  for (pde = parent; pde < parent + pd_no (PHYS_BASE); pde++)
+    if (*pde & PTE_P) 
+      {
+        uint32_t *pt, *child_pt;
+        size_t i;
+
+        if (pde_is_large (*pde) && !split_large_page (pde))
+          {
+            pagedir_destroy (pd);
+            return NULL;
+          }
+        pt = pde_get_pt (*pde);
+        child_pt = palloc_get_page (PAL_ZERO);
+        if (child_pt == NULL)
+          {
+            pagedir_destroy (pd);
+            return NULL;
+          }
+        pd[pde - parent] = pde_create (child_pt);
+
+        for (i = 0; i < PGSIZE / sizeof *pt; i++)
+          if (pt[i] & PTE_P) 
+            {
+              if (!(pt[i] & PTE_SHARED))
+                {
+                  if (pt[i] & (PTE_W | PTE_COW))
+                    pt[i] = (pt[i] & ~(uint32_t) PTE_W) | PTE_COW;
+                  pt[i] |= PTE_REF;
+                  frame_ref (pte_get_page (pt[i]));
+                  cow_shared_cnt++;
+                }
+              child_pt[i] = pt[i] & ~(uint32_t) (PTE_A | PTE_D);
+            }
+      }
+  fork_cnt++;
+  return pd;
+}
+
+/* Resolves a write fault on user page UPAGE in PD.  If UPAGE is
+   a copy-on-write page, gives PD a private, writable frame for
+   it, copying the shared one unless no other page directory
+   still maps it, and returns true.  Also returns true if the
+   shared frame was evicted meanwhile, so that the faulting
+   access is retried and pages it back in.  Returns false if
+   UPAGE is not copy-on-write or no frame is available. */
+bool
+pagedir_cow_fault (uint32_t *pd, void *upage)
+{
+  uint32_t *pte;
+  void *kpage, *copy;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte == NULL || (*pte & PTE_COW) == 0)
+    return false;
+  if ((*pte & PTE_P) == 0)
+    return true;
+
+  kpage = pte_get_page (*pte);
+  copy = NULL;
+  if (frame_refs[vtop (kpage) >> PGBITS] > 0)
+    {
+#ifdef VM
+      copy = frame_alloc (0);
+#else
+      copy = palloc_get_page (PAL_USER);
+#endif
+      if (copy == NULL)
+        return false;
+    }
+
+#ifdef VM
+  /* Keep KPAGE from being evicted while we copy it.  Obtaining
+     COPY may already have evicted it. */
+  frame_lock_acquire ();
+  if ((*pte & PTE_P) == 0)
+    {
+      if (copy != NULL)
+        frame_free (copy);
+      frame_lock_release ();
+      return true;
+    }
+#endif
+  if (copy != NULL)
+    memcpy (copy, kpage, PGSIZE);
+
+  /* The other sharers may have exited while we copied, leaving
+     us the only user of KPAGE. */
+  if (frame_unref (kpage))
+    {
+#ifdef VM
+      if (copy != NULL)
+        frame_free (copy);
+#else
+      if (copy != NULL)
+        palloc_free_page (copy);
+#endif
+      copy = kpage;
+      cow_reuse_cnt++;
+    }
+  else
+    {
+#ifdef VM
+      frame_unshare (kpage, pd);
+#endif
+      cow_copy_cnt++;
+    }
+
+  *pte = pte_create_user (copy, true) | PTE_D;
+  invalidate_page (pd, upage);
+#ifdef VM
+  frame_claim (copy, upage);
+  frame_lock_release ();
+#endif
+  return true;
+}
+
+#ifdef VM
+/* Records that one of the page directories that shared KPAGE
+   after fork() no longer maps it, because the frame table paged
+   it out.  The caller must hold the frame table lock. */
+void
+pagedir_unref_frame (void *kpage)
+{
+  frame_unref (kpage);
+}
+#endif
+
+/* Prints copy-on-write statistics. */
+void
+pagedir_print_stats (void)
+{
+  printf ("Fork: %lld forks, %lld pages shared, %lld copied on write, "
+          "%lld reused without copy, %lld large pages split\n",
+          fork_cnt, cow_shared_cnt, cow_copy_cnt, cow_reuse_cnt,
+          large_split_cnt);
+  printf ("TLB: %lld page directory loads, %lld skipped, "
+          "%lld single pages invalidated\n",
+          cr3_load_cnt, cr3_skip_cnt, invlpg_cnt);
+}
+
 /* Returns the address of the page table entry for virtual
    address VADDR in page directory PD.
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR lies in a 4 MB page, returns the address of its PDE
+   instead, whose accessed and dirty bits work the same way. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -80,6 +305,9 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  if (pde_is_large (*pde))
+    return pde;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -118,6 +346,70 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Maps the 4 MB of user virtual memory starting at UPAGE in
+   page directory PD to the 4 MB page at KPAGE, which must come
+   from palloc_get_large(), with a single PDE.  No part of that
+   region may be mapped yet.  pagedir_destroy() frees KPAGE.
+   Returns true if successful, false if part of the region
+   already has a page table. */
+bool
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage)
+{
+  uint32_t *pde;
+
+  ASSERT (large_pages);
+  ASSERT ((uintptr_t) upage % PTSPAN == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  pde = pd + pd_no (upage);
+  if (*pde != 0)
+    return false;
+  *pde = pde_create_large_user (kpage, true);
+  return true;
+}
+
+/* Returns true if the 4 MB of user virtual memory starting at
+   UPAGE in PD has no mappings at all, so that
+   pagedir_set_large_page() could map it. */
+bool
+pagedir_is_region_empty (uint32_t *pd, const void *upage)
+{
+  ASSERT ((uintptr_t) upage % PTSPAN == 0);
+  return pd[pd_no (upage)] == 0;
+}
+
+/* Adds a read-only mapping in page directory PD from user
+   virtual page UPAGE to the frame at kernel virtual address
+   KPAGE, which is owned by someone else and may be mapped by
+   other page directories too.  pagedir_destroy() does not free
+   KPAGE.
+   UPAGE must not already be mapped.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+pagedir_set_shared_page (uint32_t *pd, void *upage, void *kpage)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
+  ASSERT (pd != init_page_dir);
+
+  pte = lookup_page (pd, upage, true);
+
+  if (pte != NULL) 
+    {
+      ASSERT ((*pte & PTE_P) == 0);
+      *pte = pte_create_user (kpage, false) | PTE_SHARED;
+      return true;
+    }
+  else
+    return false;
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -128,6 +420,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   uint32_t *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  if (pde_is_large (pd[pd_no (uaddr)]))
+    return ((uint8_t *) pde_get_large_page (pd[pd_no (uaddr)])
+            + ((uintptr_t) uaddr & (PTSPAN - 1)));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -136,6 +432,28 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Removes the mapping for user virtual page UPAGE from page
+   directory PD and frees its frame, unless the frame is shared
+   and still mapped elsewhere.
+   UPAGE need not be mapped. */
+void
+pagedir_free_page (uint32_t *pd, void *upage) 
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      uint32_t old = *pte;
+      *pte = 0;
+      invalidate_page (pd, upage);
+      release_frame (pd, old);
+    }
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -152,7 +470,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +498,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,18 +527,25 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already loaded.  Loading it flushes
+   every TLB entry except the kernel's global ones. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
+  if (active_pd () == pd)
+    {
+      cr3_skip_cnt++;
+      return;
+    }
+  cr3_load_cnt++;
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -243,21 +568,94 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
+
+   This function drops the TLB entry for VADDR, with the INVLPG
+   instruction, if PD is the active page directory.  (If PD is
+   not active then its entries are not in the TLB, so there is
+   no need to invalidate anything.)  Reloading CR3 would flush
+   the whole TLB instead.  See [IA32-v3a] 3.12 "Translation
+   Lookaside Buffers (TLBs)" and [IA32-v2a] "INVLPG--Invalidate
+   TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vaddr)
+{
+  if (active_pd () == pd)
+    {
+      asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+      invlpg_cnt++;
+    }
+}
+
+/* Records one more page directory mapping KPAGE. */
+static void
+frame_ref (void *kpage)
+{
+  enum intr_level old_level = intr_disable ();
+  frame_refs[vtop (kpage) >> PGBITS]++;
+  intr_set_level (old_level);
+}
+
+/* Records that one page directory stopped mapping KPAGE.
+   Returns true if it was the last one, in which case the caller
+   now owns KPAGE outright. */
+static bool
+frame_unref (void *kpage)
+{
+  uint16_t *refs = &frame_refs[vtop (kpage) >> PGBITS];
+  enum intr_level old_level = intr_disable ();
+  bool last = *refs == 0;
+
+  if (!last)
+    (*refs)--;
+  intr_set_level (old_level);
+  return last;
+}
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+/* Frees the frame that present PTE in PD maps, unless it is
+   owned by someone else or, after fork(), still mapped by
+   another page directory. */
 static void
-invalidate_pagedir (uint32_t *pd) 
+release_frame (uint32_t *pd UNUSED, uint32_t pte)
 {
-  if (active_pd () == pd) 
+  void *kpage = pte_get_page (pte);
+
+  if (pte & PTE_SHARED)
+    return;
+  if ((pte & PTE_REF) && !frame_unref (kpage))
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+#ifdef VM
+      frame_unshare (kpage, pd);
+#endif
+      return;
+    }
+#ifdef VM
+  frame_free (kpage);
+#else
+  palloc_free_page (kpage);
+#endif
+}
+
+/* Replaces the 4 MB page that *PDE maps by a page table mapping
+   the same frames with 4 kB pages, which from then on are freed
+   one by one like any other private page.  Returns false if
+   memory allocation fails. */
+static bool
+split_large_page (uint32_t *pde)
+{
+  uint8_t *kpage = pde_get_large_page (*pde);
+  uint32_t flags = *pde & (PTE_A | PTE_D);
+  uint32_t *pt = palloc_get_page (0);
+  size_t i;
+
+  if (pt == NULL)
+    return false;
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = pte_create_user (kpage + i * PGSIZE, (*pde & PTE_W) != 0) | flags;
+  *pde = pde_create (pt);
+  large_split_cnt++;
+  return true;
 }
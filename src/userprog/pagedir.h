@@ -4,15 +4,26 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
+uint32_t *pagedir_fork (uint32_t *parent);
+bool pagedir_cow_fault (uint32_t *pd, void *upage);
+#ifdef VM
+void pagedir_unref_frame (void *kpage);
+#endif
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_set_shared_page (uint32_t *pd, void *upage, void *kpage);
+bool pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage);
+bool pagedir_is_region_empty (uint32_t *pd, const void *upage);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+void pagedir_free_page (uint32_t *pd, void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_print_stats (void);
 
 #endif /* userprog/pagedir.h */
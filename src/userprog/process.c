@@ -18,63 +18,105 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/processinfo.h"
-#include "userprog/tidmap.h"
-#include "userprog/pidmap.h"
+#include "userprog/imagecache.h"
 #include "userprog/fdmap.h"
+#include "userprog/syscall.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static thread_func start_process NO_RETURN;
+static thread_func fork_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
-static pid_t allocate_pid (void);
-
-/* Lock for allocate pid */
-static struct lock pid_lock;
+/* Handed from process_execute() to start_process().  Lives on
+   the parent's stack, which is fine because the parent blocks
+   until the child reports its load result. */
+struct exec_info
+  {
+    char *cmd_line;                     /* Page holding the command. */
+    struct process_info *info;          /* Child's process table slot. */
+#ifdef FILESYS
+    struct dir *cwd;                    /* Parent's current directory. */
+#endif
+  };
 
-static struct lock filesys_lock;
+/* Handed from process_fork() to fork_process().  Lives on the
+   parent's stack, like struct exec_info. */
+struct fork_info
+  {
+    struct thread *parent;              /* Process being duplicated. */
+    struct intr_frame *if_;             /* Its user context. */
+    struct process_info *info;          /* Child's process table slot. */
+  };
 
 /* Init process system (My code) */
 void 
 process_init ()
 {
-  lock_init (&pid_lock);
-  lock_init (&filesys_lock);
   process_info_init ();
+  fdmap_init ();
+  imagecache_init ();
+  pagedir_init ();
 }
 
 /* Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
-tid_t
+   FILE_NAME and waits for it to finish loading.  Returns the
+   new process's pid, or PID_ERROR if the process table is full,
+   the thread cannot be created or the program fails to load. */
+pid_t
 process_execute (const char *file_name) 
 {
-  char *fn_copy;
+  struct exec_info exec;
   tid_t tid;
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0); // get the page from the kenel pool
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  exec.cmd_line = palloc_get_page (0); // get the page from the kenel pool
+  if (exec.cmd_line == NULL)
+    return PID_ERROR;
+  strlcpy (exec.cmd_line, file_name, PGSIZE);
+
+  exec.info = process_info_create (thread_current ());
+#ifdef FILESYS
+  exec.cwd = thread_current ()->cwd;
+#endif
+  if (exec.info == NULL)
+    {
+      palloc_free_page (exec.cmd_line);
+      return PID_ERROR;
+    }
 
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
+  tid = thread_create (file_name, PRI_DEFAULT, start_process, &exec);
   if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
-
-  struct thread *t = thread_current ();
-  t->tidmap = add_tidmap (t->tidmap, tid);  /* Save current thread's child's tid */
+    {
+      palloc_free_page (exec.cmd_line); 
+      process_info_exit (exec.info);
+      process_info_wait_exit (exec.info);
+      return PID_ERROR;
+    }
 
-  return tid;
+  /* A child that failed to load exits right away; reap it here
+     so its slot does not linger in our children list. */
+  if (!process_info_wait_load (exec.info))
+    {
+      process_info_wait_exit (exec.info);
+      return PID_ERROR;
+    }
+  return exec.info->pid;
 }
 
 /* A thread function that loads a user process and starts it
    running. */
 static void
-start_process (void *file_name_)
+start_process (void *exec_)
 {
-  char *file_name = file_name_;
+  struct exec_info *exec = exec_;
+  char *file_name = exec->cmd_line;
+  struct process_info *info = exec->info;
   struct intr_frame if_;
   bool success;
 
@@ -84,15 +126,24 @@ start_process (void *file_name_)
   char *token, *save_ptr;
   real_file_name = strtok_r (file_name, " ", &save_ptr);
 
+  thread_current ()->proc = info;
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
 
-  filesys_lock_acquire ();
+#ifdef FILESYS
+  /* Start in the parent's current directory, so that relative
+     paths, including the program's own, work the same for both. */
+  if (exec->cwd != NULL)
+    thread_current ()->cwd = dir_reopen (exec->cwd);
+  success = ((exec->cwd == NULL || thread_current ()->cwd != NULL)
+             && load (real_file_name, &if_.eip, &if_.esp));
+#else
   success = load (real_file_name, &if_.eip, &if_.esp);
-  filesys_lock_release ();
+#endif
 
   /* My code */
   /* If load failed, quit. */
@@ -100,7 +151,7 @@ start_process (void *file_name_)
   struct thread *t = thread_current ();
 
   if (!success) {
-    update_pid (t->tid, -1);
+    process_info_set_load (info, false);
     palloc_free_page (file_name);
     thread_exit ();
   }
@@ -112,9 +163,9 @@ start_process (void *file_name_)
   t->is_userprog = true;
   t->process_name = palloc_get_page (PAL_ZERO);  // palloc_get_page (PAL_ZERO) return the name
   strlcpy (t->process_name, real_file_name, PGSIZE);  // real_file_name copy to t->process_name
-  t->pid = allocate_pid (); 
+  t->pid = info->pid;
 
-  update_pid (t->tid, t->pid);
+  process_info_set_load (info, true);
 
   *arg_p_tail = real_file_name;
   arg_p_tail += 4;
@@ -186,23 +237,131 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
-/* Waits for thread TID to die and returns its exit status.  If
+/* Duplicates the current process, which entered the kernel
+   with user context IF_, and waits for the copy to be set up.
+   The child shares the parent's pages copy-on-write, inherits
+   its open files and returns 0 from the system call.  Returns
+   the child's pid, or PID_ERROR if it could not be created. */
+pid_t
+process_fork (struct intr_frame *if_)
+{
+  struct fork_info fork;
+  tid_t tid;
+
+  fork.parent = thread_current ();
+  fork.if_ = if_;
+  fork.info = process_info_create (fork.parent);
+  if (fork.info == NULL)
+    return PID_ERROR;
+
+  tid = thread_create (fork.parent->name, PRI_DEFAULT, fork_process, &fork);
+  if (tid == TID_ERROR)
+    {
+      process_info_exit (fork.info);
+      process_info_wait_exit (fork.info);
+      return PID_ERROR;
+    }
+
+  if (!process_info_wait_load (fork.info))
+    {
+      process_info_wait_exit (fork.info);
+      return PID_ERROR;
+    }
+  return fork.info->pid;
+}
+
+/* A thread function that turns a new thread into a copy of the
+   forking process and starts it running. */
+static void
+fork_process (void *fork_)
+{
+  struct fork_info *fork = fork_;
+  struct thread *parent = fork->parent;
+  struct process_info *info = fork->info;
+  struct thread *t = thread_current ();
+  struct intr_frame if_;
+  bool success = false;
+
+  t->proc = info;
+  if_ = *fork->if_;
+
+  /* Share the address space. */
+#ifdef VM
+  frame_lock_acquire ();
+  t->pagedir = pagedir_fork (parent->pagedir);
+  if (t->pagedir != NULL)
+    t->pages = page_table_copy (parent->pages, t->pagedir);
+  frame_lock_release ();
+  if (t->pages == NULL)
+    goto done;
+#else
+  t->pagedir = pagedir_fork (parent->pagedir);
+#endif
+  if (t->pagedir == NULL)
+    goto done;
+  process_activate ();
+  t->image = imagecache_dup (parent->image);
+
+  t->process_name = palloc_get_page (0);
+  if (t->process_name == NULL)
+    goto done;
+  strlcpy (t->process_name, parent->process_name, PGSIZE);
+
+  /* Inherit the executable and the open files. */
+  if (parent->file != NULL)
+    {
+      t->file = file_reopen (parent->file);
+      if (t->file != NULL)
+        file_deny_write (t->file);
+    }
+  success = ((parent->file == NULL || t->file != NULL)
+             && fdmap_duplicate (parent->fdmap, &t->fdmap));
+#ifdef FILESYS
+  if (success && parent->cwd != NULL)
+    {
+      t->cwd = dir_reopen (parent->cwd);
+      success = t->cwd != NULL;
+    }
+#endif
+#ifdef VM
+  success = success && mmap_fork (parent);
+#endif
+  t->fd_base = parent->fd_base;
+
+  if (success)
+    {
+      t->is_userprog = true;
+      t->pid = info->pid;
+    }
+
+ done:
+  process_info_set_load (info, success);
+  if (!success)
+    {
+      palloc_free_page (t->process_name);
+      t->process_name = NULL;
+      thread_exit ();
+    }
+
+  /* Return to user mode as if from the fork() system call. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Waits for process PID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
-   exception), returns -1.  If TID is invalid or if it was not a
+   exception), returns -1.  If PID is invalid or if it was not a
    child of the calling process, or if process_wait() has already
-   been successfully called for the given TID, returns -1
-   immediately, without waiting.
-
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+   been successfully called for the given PID, returns -1
+   immediately, without waiting. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_wait (pid_t child_pid) 
 {
-  struct thread *t = thread_current ();
-  if (contains_tidmap (t->tidmap, child_tid)) {
-    return get_exit_stauts (child_tid);
-  }
-  return -1;
+  struct process_info *info = process_info_lookup (child_pid);
+  if (info == NULL || info->parent != thread_current ())
+    return -1;
+  return process_info_wait_exit (info);
 }
 
 /* Free the current process's resources. */
@@ -220,13 +379,21 @@ process_exit (void)
     palloc_free_page(cur->process_name);
   }
 
+  syscall_free_buffer ();
+
+#ifdef VM
+  /* Write modified mapped pages back while the page directory
+     still says which ones they are. */
+  mmap_unmap_all ();
+#endif
+
   file = cur->file;
   if (file != NULL)
-  {
-    filesys_lock_acquire ();
     file_close (file);
-    filesys_lock_release ();
-  }
+#ifdef FILESYS
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+#endif
 
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
@@ -242,12 +409,30 @@ process_exit (void)
          that's been freed (and cleared). */
       cur->pagedir = NULL;
       pagedir_activate (NULL);
+#ifdef VM
+      /* Hold the frame table still, so that no frame is evicted
+         from PD while it is being taken apart. */
+      frame_lock_acquire ();
+      pagedir_destroy (pd);
+      frame_lock_release ();
+#else
       pagedir_destroy (pd);
+#endif
     }
 
-  singal_exit_status (cur->tid);
-  destroy_tidmap (cur->tidmap);
-  destroy_pidmap (cur->pidmap);
+#ifdef VM
+  page_table_destroy (cur->pages);
+  cur->pages = NULL;
+#endif
+
+  /* Only now that no page directory maps its shared frames may
+     the image be evicted. */
+  imagecache_put (cur->image);
+  cur->image = NULL;
+
+  process_info_orphan_children (cur);
+  if (cur->proc != NULL)
+    process_info_exit (cur->proc);
   fdmap_destroy (cur->fdmap);
 }
 
@@ -267,74 +452,11 @@ process_activate (void)
   tss_update ();
 }
 
-/* We load ELF binaries.  The following definitions are taken
-   from the ELF specification, [ELF1], more-or-less verbatim.  */
-
-/* ELF types.  See [ELF1] 1-2. */
-typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
-typedef uint16_t Elf32_Half;
-
-/* For use with ELF types in printf(). */
-#define PE32Wx PRIx32   /* Print Elf32_Word in hexadecimal. */
-#define PE32Ax PRIx32   /* Print Elf32_Addr in hexadecimal. */
-#define PE32Ox PRIx32   /* Print Elf32_Off in hexadecimal. */
-#define PE32Hx PRIx16   /* Print Elf32_Half in hexadecimal. */
-
-/* Executable header.  See [ELF1] 1-4 to 1-8.
-   This appears at the very beginning of an ELF binary. */
-struct Elf32_Ehdr
-  {
-    unsigned char e_ident[16];
-    Elf32_Half    e_type;
-    Elf32_Half    e_machine;
-    Elf32_Word    e_version;
-    Elf32_Addr    e_entry;
-    Elf32_Off     e_phoff;
-    Elf32_Off     e_shoff;
-    Elf32_Word    e_flags;
-    Elf32_Half    e_ehsize;
-    Elf32_Half    e_phentsize;
-    Elf32_Half    e_phnum;
-    Elf32_Half    e_shentsize;
-    Elf32_Half    e_shnum;
-    Elf32_Half    e_shstrndx;
-  };
-
-/* Program header.  See [ELF1] 2-2 to 2-4.
-   There are e_phnum of these, starting at file offset e_phoff
-   (see [ELF1] 1-6). */
-struct Elf32_Phdr
-  {
-    Elf32_Word p_type;
-    Elf32_Off  p_offset;
-    Elf32_Addr p_vaddr;
-    Elf32_Addr p_paddr;
-    Elf32_Word p_filesz;
-    Elf32_Word p_memsz;
-    Elf32_Word p_flags;
-    Elf32_Word p_align;
-  };
-
-/* Values for p_type.  See [ELF1] 2-3. */
-#define PT_NULL    0            /* Ignore. */
-#define PT_LOAD    1            /* Loadable segment. */
-#define PT_DYNAMIC 2            /* Dynamic linking info. */
-#define PT_INTERP  3            /* Name of dynamic loader. */
-#define PT_NOTE    4            /* Auxiliary info. */
-#define PT_SHLIB   5            /* Reserved. */
-#define PT_PHDR    6            /* Program header table. */
-#define PT_STACK   0x6474e551   /* Stack segment. */
-
-/* Flags for p_flags.  See [ELF3] 2-3 and 2-4. */
-#define PF_X 1          /* Executable. */
-#define PF_W 2          /* Writable. */
-#define PF_R 4          /* Readable. */
-
 static bool setup_stack (void **esp);
-static bool validate_segment (const struct Elf32_Phdr *, struct file *);
-static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
-                          uint32_t read_bytes, uint32_t zero_bytes,
-                          bool writable);
+#ifndef VM
+static bool load_segment (struct file *file, struct image *image,
+                          struct image_segment *seg);
+#endif
 
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
@@ -344,9 +466,8 @@ bool
 load (const char *file_name, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
   struct file *file = NULL;
-  off_t file_ofs;
+  struct image *image;
   bool success = false;
   int i;
 
@@ -355,6 +476,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
+#ifdef VM
+  t->pages = page_table_create ();
+  if (t->pages == NULL)
+    goto done;
+#endif
 
   /* Open executable file. */
   file = filesys_open (file_name);
@@ -365,84 +491,31 @@ load (const char *file_name, void (**eip) (void), void **esp)
     }
 
   file_deny_write (file);
-  /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
-      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
-      || ehdr.e_type != 2
-      || ehdr.e_machine != 3
-      || ehdr.e_version != 1
-      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
-      || ehdr.e_phnum > 1024) 
+  /* Read and verify executable and program headers, or reuse
+     the ones cached by an earlier exec of the same file. */
+  image = t->image = imagecache_get (file);
+  if (image == NULL)
     {
       printf ("load: %s: error loading executable\n", file_name);
       goto done; 
     }
 
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
-  for (i = 0; i < ehdr.e_phnum; i++) 
-    {
-      struct Elf32_Phdr phdr;
-
-      if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
-      file_ofs += sizeof phdr;
-      switch (phdr.p_type) 
-        {
-        case PT_NULL:
-        case PT_NOTE:
-        case PT_PHDR:
-        case PT_STACK:
-        default:
-          /* Ignore this segment. */
-          break;
-        case PT_DYNAMIC:
-        case PT_INTERP:
-        case PT_SHLIB:
-          goto done;
-        case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
-            {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
-                {
-                  /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
-                }
-              else 
-                {
-                  /* Entirely zero.
-                     Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-                }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
-            }
-          else
-            goto done;
-          break;
-        }
-    }
+  /* With virtual memory, segments are only registered here and
+     each page is read on first touch; see page_in(). */
+  for (i = 0; i < image->segment_cnt; i++)
+#ifdef VM
+    if (!page_add_segment (&image->segments[i]))
+#else
+    if (!load_segment (file, image, &image->segments[i]))
+#endif
+      goto done;
 
   /* Set up stack. */
   if (!setup_stack (esp))
     goto done;
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = (void (*) (void)) image->entry;
 
   success = true;
 
@@ -451,120 +524,115 @@ load (const char *file_name, void (**eip) (void), void **esp)
   thread_current ()-> file = file;
   return success;
 }
-
+
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
 
-/* Checks whether PHDR describes a valid, loadable segment in
-   FILE and returns true if so, false otherwise. */
-static bool
-validate_segment (const struct Elf32_Phdr *phdr, struct file *file) 
-{
-  /* p_offset and p_vaddr must have the same page offset. */
-  if ((phdr->p_offset & PGMASK) != (phdr->p_vaddr & PGMASK)) 
-    return false; 
-
-  /* p_offset must point within FILE. */
-  if (phdr->p_offset > (Elf32_Off) file_length (file)) 
-    return false;
-
-  /* p_memsz must be at least as big as p_filesz. */
-  if (phdr->p_memsz < phdr->p_filesz) 
-    return false; 
-
-  /* The segment must not be empty. */
-  if (phdr->p_memsz == 0)
-    return false;
-  
-  /* The virtual memory region must both start and end within the
-     user address space range. */
-  if (!is_user_vaddr ((void *) phdr->p_vaddr))
-    return false;
-  if (!is_user_vaddr ((void *) (phdr->p_vaddr + phdr->p_memsz)))
-    return false;
-
-  /* The region cannot "wrap around" across the kernel virtual
-     address space. */
-  if (phdr->p_vaddr + phdr->p_memsz < phdr->p_vaddr)
-    return false;
-
-  /* Disallow mapping page 0.
-     Not only is it a bad idea to map page 0, but if we allowed
-     it then user code that passed a null pointer to system calls
-     could quite likely panic the kernel by way of null pointer
-     assertions in memcpy(), etc. */
-  if (phdr->p_vaddr < PGSIZE)
-    return false;
-
-  /* It's okay. */
-  return true;
-}
-
-/* Loads a segment starting at offset OFS in FILE at address
-   UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
-   memory are initialized, as follows:
+/* Loads segment SEG of IMAGE from FILE into the current
+   process.  In total, SEG->READ_BYTES + SEG->ZERO_BYTES bytes of
+   virtual memory are initialized at SEG->UPAGE, as follows:
 
         - READ_BYTES bytes at UPAGE must be read from FILE
-          starting at offset OFS.
+          starting at offset SEG->FILE_PAGE.
 
         - ZERO_BYTES bytes at UPAGE + READ_BYTES must be zeroed.
 
-   The pages initialized by this function must be writable by the
-   user process if WRITABLE is true, read-only otherwise.
+   Pages of a read-only segment are mapped shared from the image
+   cache when it can supply them.  Other pages are private
+   copies, writable by the user process if SEG->WRITABLE is
+   true.
 
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
-load_segment (struct file *file, off_t ofs, uint8_t *upage,
-              uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
+load_segment (struct file *file, struct image *image,
+              struct image_segment *seg) 
 {
+  struct thread *t = thread_current ();
+  uint32_t read_bytes = seg->read_bytes;
+  uint32_t zero_bytes = seg->zero_bytes;
+  uint8_t *upage = seg->upage;
+  off_t ofs = seg->file_page;
+  size_t page_idx;
+
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
+  for (page_idx = 0; read_bytes > 0 || zero_bytes > 0; page_idx++)
     {
       /* Calculate how to fill this page.
          We will read PAGE_READ_BYTES bytes from FILE
          and zero the final PAGE_ZERO_BYTES bytes. */
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
+      uint8_t *kpage = NULL;
 
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      if (kpage == NULL)
-        return false;
-
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
+      /* Share the frame cached for a read-only page. */
+      if (!seg->writable)
+        kpage = imagecache_page (image, seg, page_idx, file);
+      if (kpage != NULL)
         {
-          palloc_free_page (kpage);
-          return false; 
+          if (pagedir_get_page (t->pagedir, upage) != NULL
+              || !pagedir_set_shared_page (t->pagedir, upage, kpage))
+            return false;
         }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable)) 
+      else
         {
-          palloc_free_page (kpage);
-          return false; 
+          /* Get a page of memory, dropping unused cached images
+             if the user pool has run dry. */
+          kpage = palloc_get_page (PAL_USER);
+          while (kpage == NULL && imagecache_shrink ())
+            kpage = palloc_get_page (PAL_USER);
+          if (kpage == NULL)
+            return false;
+
+          /* Load this page. */
+          if (file_read_at (file, kpage, page_read_bytes, ofs)
+              != (int) page_read_bytes)
+            {
+              palloc_free_page (kpage);
+              return false; 
+            }
+          memset (kpage + page_read_bytes, 0, page_zero_bytes);
+
+          /* Add the page to the process's address space. */
+          if (!install_page (upage, kpage, seg->writable)) 
+            {
+              palloc_free_page (kpage);
+              return false; 
+            }
         }
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
+      ofs += PGSIZE;
     }
   return true;
 }
 
+#endif /* !VM */
+
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
 setup_stack (void **esp) 
 {
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  /* The arguments are pushed right away, so bring the page in
+     now. */
+  if (!page_add_zero (upage, true) || !page_in (upage))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
+
   uint8_t *kpage;
   bool success = false;
 
@@ -578,8 +646,11 @@ setup_stack (void **esp)
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
+#ifndef VM
+
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -599,36 +670,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
-
-/* My function */
-/* Returns a pid to use for a new process. */
-static pid_t
-allocate_pid (void) 
-{
-  static pid_t next_pid = 1; // can preserve value after function exit.
-  pid_t pid;
-
-  lock_acquire (&pid_lock);
-  pid = next_pid++;
-  lock_release (&pid_lock);
-
-  return pid;
-}
-
-/* Called when finish, clear the resources use for process */
-void
-process_finish (void)
-{
-  destroy_hash_process_infos ();
-}
-
-void 
-filesys_lock_acquire (void)
-{
-  lock_acquire (&filesys_lock);
-}
-
-void filesys_lock_release (void)
-{
-  lock_release (&filesys_lock);
-}
+#endif /* !VM */
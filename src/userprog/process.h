@@ -4,13 +4,11 @@
 #include "threads/thread.h"
 
 void process_init (void);
-tid_t process_execute (const char *file_name);
-int process_wait (tid_t);
+pid_t process_execute (const char *file_name);
+struct intr_frame;
+pid_t process_fork (struct intr_frame *);
+int process_wait (pid_t);
 void process_exit (void);
 void process_activate (void);
-void process_finish (void);
-
-void filesys_lock_acquire (void);
-void filesys_lock_release (void);
 
 #endif /* userprog/process.h */
@@ -1,229 +1,196 @@
 #include "threads/thread.h"
 #include "userprog/processinfo.h"
-#include "userprog/process.h"
+#include "threads/interrupt.h"
 #include "threads/synch.h"
-#include "threads/palloc.h"
-#include "threads/malloc.h"
+#include <stdio.h>
 #include <list.h>
-#include <hash.h>
 #include <debug.h>
 
-/* Use for share data between child process and parent process
-   Destory data about children after parent thread exit
-*/
+/* Use for share data between child process and parent process.
 
-/* List for tell exec program that callee with tid = ** has pid = ** */
-static struct hash hash_process_infos;
-static struct lock process_info_lock;
+   Every user process owns one slot of a fixed process table.
+   A pid is the slot index in the low PROC_SLOT_BITS bits and
+   the slot's generation above them, so looking up a pid is a
+   single array access plus a generation check and needs no
+   global lock.  Slots are handed out from a free list; the
+   short critical sections that touch the free list or a slot's
+   reference count run with interrupts off, which is enough on
+   our uniprocessor.
 
-struct process_info
-{
-  tid_t tid;                             /* Identify process */
-
-  pid_t pid;                             /* Data for syscall_exec() */
-  bool finish_pid;
-  struct condition pid_cond;         
-
-  int exit_status; 					     /* Data for syscall_exit() */
-  bool finish_exit;                      
-  struct condition exit_cond;
-
-  struct hash_elem helem;                /* Use for hash map */
-};
-
-static unsigned process_info_hash (const struct hash_elem *p_, void *aux UNUSED);
-static bool process_info_less (const struct hash_elem *a_, const struct hash_elem *b_,
-	void *aux UNUSED);
-/*
-  Function use for hashmap
-*/
-static unsigned 
-process_info_hash (const struct hash_elem *p_, void *aux UNUSED)
-{
-	struct process_info *p = hash_entry (p_, struct process_info, helem);
-	return hash_int (p->tid);
-}
+   A slot is released once both the parent (after wait() or its
+   own exit) and the child (after its exit) dropped their
+   references. */
+static struct process_info process_table[PROC_SLOT_CNT];
+static struct list free_slots;
 
-static bool 
-process_info_less (const struct hash_elem *a_, const struct hash_elem *b_,
-	void *aux UNUSED)
-{
-	const struct  process_info *a = hash_entry (a_, struct process_info, helem);
-	const struct  process_info *b = hash_entry (b_, struct process_info, helem);
-	return a->tid < b->tid;
-}
+/* Statistics. */
+static int slots_in_use;
+static int slots_peak;
+static long long slots_created;
 
-static void 
-hash_free_function (struct hash_elem *element, void *aux UNUSED)
-{
-  struct process_info *entry = hash_entry (element, struct process_info, helem);
-  free (entry);
-}
+static void release (struct process_info *info);
 
 void
 process_info_init ()
 {
-  lock_init (&process_info_lock);
-  hash_init (&hash_process_infos, process_info_hash, process_info_less, NULL);
+  int i;
+
+  list_init (&free_slots);
+  for (i = 0; i < PROC_SLOT_CNT; i++)
+    {
+      struct process_info *info = &process_table[i];
+      info->generation = 1;
+      info->pid = PID_ERROR;
+      sema_init (&info->load_sema, 0);
+      sema_init (&info->exit_sema, 0);
+      list_push_back (&free_slots, &info->child_elem);
+    }
 }
 
-/* 
-   Called in thread_create
-   Create condition that syscall_exec call wait on
-*/
-void 
-add_process_info (tid_t tid)
+/* Called in process_execute ()
+   Takes a free slot, links it into PARENT's children list and
+   returns it, or NULL if the process table is full. */
+struct process_info *
+process_info_create (struct thread *parent)
 {
-	lock_acquire (&process_info_lock);
-
-	struct process_info *new_process_info = malloc (sizeof (struct process_info));
-
-	new_process_info->tid = tid;
-
-	new_process_info->pid = -1;
-	new_process_info->finish_pid = false;
-	cond_init (&new_process_info->pid_cond);
-
-	new_process_info->exit_status = -1;
-	new_process_info->finish_exit = false;
-	cond_init (&new_process_info->exit_cond);
-
-	hash_insert (&hash_process_infos, &new_process_info->helem);
-
-	lock_release (&process_info_lock);
+  struct process_info *info;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (list_empty (&free_slots))
+    {
+      intr_set_level (old_level);
+      return NULL;
+    }
+  info = list_entry (list_pop_front (&free_slots), struct process_info,
+                     child_elem);
+  if (++slots_in_use > slots_peak)
+    slots_peak = slots_in_use;
+  slots_created++;
+  intr_set_level (old_level);
+
+  info->pid = (pid_t) ((info->generation << PROC_SLOT_BITS)
+                       | (unsigned) (info - process_table));
+  info->refs = 2;
+  info->parent = parent;
+  info->load_success = false;
+  info->exit_status = -1;
+  sema_init (&info->load_sema, 0);
+  sema_init (&info->exit_sema, 0);
+  list_push_back (&parent->children, &info->child_elem);
+
+  return info;
 }
 
-/* Called in syscall_exec
-   Get the pid of the process it create
-   If the process haven't finish load, release the lock
-   and wait on condition
-*/
-pid_t 
-get_pid (tid_t tid)
+/* Returns the slot that currently holds PID, or NULL if PID is
+   stale or out of range. */
+struct process_info *
+process_info_lookup (pid_t pid)
 {
-	lock_acquire (&process_info_lock);
-	struct process_info search_key;
-	search_key.tid = tid;
-
-	struct hash_elem *value_;
-	value_ = hash_find (&hash_process_infos, &search_key.helem);
-	struct process_info* value = hash_entry (value_, struct process_info, helem);
-	while (!value->finish_pid)
-		cond_wait (&value->pid_cond, &process_info_lock);
-	
-	int result = value->pid;
-	lock_release (&process_info_lock);
-	return result;
+  struct process_info *info;
+
+  if (pid < 0)
+    return NULL;
+  info = &process_table[pid & PROC_SLOT_MASK];
+  return info->pid == pid ? info : NULL;
 }
 
 /* Called when process finish load
-   Update the pid after load result 
-   Signal caller process that is waiting */
-void 
-update_pid (tid_t tid, pid_t pid)
+   Records the load result and wakes the parent in exec. */
+void
+process_info_set_load (struct process_info *info, bool success)
 {
-	lock_acquire (&process_info_lock);
-	struct process_info search_key;
-	search_key.tid = tid;
-
-	struct hash_elem *value_;
-	value_ = hash_find (&hash_process_infos, &search_key.helem);
-	struct process_info *value = hash_entry (value_, struct process_info, helem);
-
-	value->finish_pid = true;
-	value->pid = pid;
-
-	cond_signal (&value->pid_cond, &process_info_lock);
-	lock_release (&process_info_lock);
+  info->load_success = success;
+  sema_up (&info->load_sema);
 }
 
-/* Called in thread_wait
-   Get the exit status of the thread it create
-   If the process haven't finish exit, release the lock
-   and wait on condition
-*/
-int 
-get_exit_stauts (tid_t tid)
+/* Called in process_execute ()
+   Blocks until the child has finished loading and returns
+   whether the load succeeded. */
+bool
+process_info_wait_load (struct process_info *info)
 {
-	lock_acquire (&process_info_lock);
-	struct process_info search_key;
-	search_key.tid = tid;
-
-	struct hash_elem *value_;
-	value_ = hash_find (&hash_process_infos, &search_key.helem);
-	struct process_info* value = hash_entry (value_, struct process_info, helem);
-
-	while (!value->finish_exit)
-		cond_wait (&value->exit_cond, &process_info_lock);
-	
-	/* To avoid process_wait () call agian for same tid, set exit_status = -1 */
-	int result = value->exit_status;
-	value->exit_status = -1;
-
-	lock_release (&process_info_lock);
-	return result;
+  sema_down (&info->load_sema);
+  return info->load_success;
 }
 
 /* Called in syscall_exit()
-   Update the exit result
-*/
+   Update the exit result */
 void
-update_exit_status (tid_t tid, int status)
+process_info_set_exit_status (struct process_info *info, int status)
 {
-	lock_acquire (&process_info_lock);
-
-	struct process_info search_key;
-	search_key.tid = tid;
-	struct hash_elem *value_ = hash_find (&hash_process_infos, &search_key.helem);
-	struct process_info *value = hash_entry (value_, struct process_info, helem);
-
-	value->exit_status = status;
-
-	lock_release (&process_info_lock);
+  info->exit_status = status;
 }
 
-/* Called in thread_exit ()
-   Signal caller thread that is waiting for current thread
-*/
+/* Called in process_exit ()
+   Signal the parent that is waiting for current process and
+   drop the child's reference. */
 void
-singal_exit_status (tid_t tid)
+process_info_exit (struct process_info *info)
 {
-	lock_acquire (&process_info_lock);
+  sema_up (&info->exit_sema);
+  release (info);
+}
 
-	struct process_info search_key;
-	search_key.tid = tid;
-	struct hash_elem *value_ = hash_find (&hash_process_infos, &search_key.helem);
-	struct process_info *value = hash_entry (value_, struct process_info, helem);
+/* Called in process_wait ()
+   Waits for the child to exit, then detaches it from the
+   parent so the same pid cannot be waited for twice. */
+int
+process_info_wait_exit (struct process_info *info)
+{
+  int status;
 
-	value->finish_exit = true;
-	cond_signal (&value->exit_cond, &process_info_lock);
+  sema_down (&info->exit_sema);
+  status = info->exit_status;
 
-	lock_release (&process_info_lock);
+  list_remove (&info->child_elem);
+  info->parent = NULL;
+  release (info);
+  return status;
 }
 
-/* 
-   Called when parent process exit
-   Destroy all info about child 
-   Free resources
-*/
-void destroy_process_info (tid_t tid)
+/* Called when parent process exit
+   Drops the parent's reference to every child that was never
+   waited for. */
+void
+process_info_orphan_children (struct thread *parent)
 {
-  lock_acquire (&process_info_lock);
-
-  struct process_info search_key;
-  search_key.tid = tid;
-  struct hash_elem *value_ = hash_delete (&hash_process_infos, &search_key.helem);
-  struct process_info *value = hash_entry (value_, struct process_info, helem);
+  while (!list_empty (&parent->children))
+    {
+      struct list_elem *e = list_pop_front (&parent->children);
+      struct process_info *info = list_entry (e, struct process_info,
+                                              child_elem);
+      info->parent = NULL;
+      release (info);
+    }
+}
 
-  free(value);
-  lock_release (&process_info_lock);
+/* Prints process table statistics. */
+void
+process_info_print_stats (void)
+{
+  printf ("Process table: %lld processes created, %d of %d slots peak\n",
+          slots_created, slots_peak, PROC_SLOT_CNT);
 }
 
-/*
-  Called before initial process finish
-  Free resources use for this hash map
-*/
-void destroy_hash_process_infos ()
+/* Drops one reference to INFO and returns the slot to the free
+   list when no references remain.  Bumping the generation
+   invalidates every pid that referred to the old occupant. */
+static void
+release (struct process_info *info)
 {
-  hash_destroy (&hash_process_infos, hash_free_function);
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (info->refs > 0);
+  if (--info->refs == 0)
+    {
+      info->pid = PID_ERROR;
+      info->generation = (info->generation + 1)
+                         & ((1u << (31 - PROC_SLOT_BITS)) - 1);
+      if (info->generation == 0)
+        info->generation = 1;
+      slots_in_use--;
+      list_push_back (&free_slots, &info->child_elem);
+    }
+  intr_set_level (old_level);
 }
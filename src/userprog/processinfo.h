@@ -1,14 +1,46 @@
 #ifndef _PROC_INFO_
 #define _PROC_INFO_
 
+#include <list.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Number of bits of a pid that select a process table slot.
+   The remaining high bits hold the slot's generation, so a pid
+   that refers to a recycled slot is never mistaken for the new
+   occupant. */
+#define PROC_SLOT_BITS 8
+#define PROC_SLOT_CNT (1 << PROC_SLOT_BITS)
+#define PROC_SLOT_MASK (PROC_SLOT_CNT - 1)
+
+/* Data shared between a child process and its parent.
+   Lives in a slot of the process table until both the parent
+   and the child are done with it. */
+struct process_info
+{
+  pid_t pid;                             /* Generation-tagged slot id. */
+  unsigned generation;                   /* Bumped each time slot is freed. */
+  int refs;                              /* Parent and child references. */
+
+  struct thread *parent;                 /* Parent thread, NULL if orphaned. */
+  struct list_elem child_elem;           /* Parent's children list, or free list. */
+
+  bool load_success;                     /* Data for syscall_exec() */
+  struct semaphore load_sema;
+
+  int exit_status;                       /* Data for syscall_wait() */
+  struct semaphore exit_sema;
+};
+
 void process_info_init (void);
-void add_process_info (tid_t tid);
-pid_t get_pid (tid_t tid);
-void update_pid (tid_t tid, pid_t pid);
-int get_exit_stauts (tid_t tid);
-void update_exit_status (tid_t tid, int status);
-void destroy_process_info (tid_t tid);
-void singal_exit_status (tid_t tid);
-void destroy_hash_process_infos (void);
-
-#endif
\ No newline at end of file
+struct process_info *process_info_create (struct thread *parent);
+struct process_info *process_info_lookup (pid_t pid);
+void process_info_set_load (struct process_info *info, bool success);
+bool process_info_wait_load (struct process_info *info);
+void process_info_set_exit_status (struct process_info *info, int status);
+void process_info_exit (struct process_info *info);
+int process_info_wait_exit (struct process_info *info);
+void process_info_orphan_children (struct thread *parent);
+void process_info_print_stats (void);
+
+#endif
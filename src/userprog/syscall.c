@@ -2,27 +2,39 @@
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <string.h>
+#include <round.h>
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/init.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
 #include "userprog/processinfo.h"
-#include "userprog/pidmap.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#ifdef FILESYS
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#endif
+#include "devices/block.h"
 #include "devices/input.h"
 #include "userprog/fdmap.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
 static void check_user_vaddr (void *vaddr, size_t);
 static void check_user_vaddr_single (void *vaddr);
+static int file_io (struct file *, void *buffer, int size, bool write);
 static void syscall_halt (void);
 static void syscall_exit (struct intr_frame *);
 static void syscall_exec (struct intr_frame *);
 static void syscall_wait (struct intr_frame *);
+static void syscall_fork (struct intr_frame *);
 static void syscall_create (struct intr_frame *);
 static void syscall_remove (struct intr_frame *);
 static void syscall_open (struct intr_frame *f);
@@ -32,6 +44,18 @@ static void syscall_write (struct intr_frame *);
 static void syscall_seek (struct intr_frame *f);
 static void syscall_tell (struct intr_frame *f);
 static void syscall_close (struct intr_frame *f);
+#ifdef VM
+static void syscall_mmap (struct intr_frame *f);
+static void syscall_munmap (struct intr_frame *f);
+#endif
+#ifdef FILESYS
+static void syscall_chdir (struct intr_frame *f);
+static void syscall_mkdir (struct intr_frame *f);
+static void syscall_readdir (struct intr_frame *f);
+static void syscall_isdir (struct intr_frame *f);
+static void syscall_inumber (struct intr_frame *f);
+static bool is_dir_file (struct file *);
+#endif
 
 void
 syscall_init (void) 
@@ -42,6 +66,11 @@ syscall_init (void)
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
+#ifdef VM
+  /* Page faults in the kernel need this to tell stack growth
+     from a bad pointer. */
+  thread_current ()->user_esp = f->esp;
+#endif
   check_user_vaddr (f->esp, sizeof(int)); //check the invalid pointers passed by user.
   int *call_number_addr = (int *)f->esp;  //the system call number is in the 32-bit word at the caller's stack pointer
   int call_number = *call_number_addr;
@@ -58,6 +87,9 @@ syscall_handler (struct intr_frame *f UNUSED)
     case SYS_WAIT:
     	syscall_wait (f);
     	break;
+    case SYS_FORK:                   /* Duplicate this process. */
+    	syscall_fork (f);
+    	break;
     case SYS_CREATE:                 /* Create a file. */
     	syscall_create (f);
     	break;
@@ -85,6 +117,31 @@ syscall_handler (struct intr_frame *f UNUSED)
     case SYS_CLOSE:                  /* Close a file. */
     	syscall_close (f);
     	break;
+#ifdef VM
+    case SYS_MMAP:                   /* Map a file into memory. */
+    	syscall_mmap (f);
+    	break;
+    case SYS_MUNMAP:                 /* Remove a memory mapping. */
+    	syscall_munmap (f);
+    	break;
+#endif
+#ifdef FILESYS
+    case SYS_CHDIR:                  /* Change the current directory. */
+    	syscall_chdir (f);
+    	break;
+    case SYS_MKDIR:                  /* Create a directory. */
+    	syscall_mkdir (f);
+    	break;
+    case SYS_READDIR:                /* Reads a directory entry. */
+    	syscall_readdir (f);
+    	break;
+    case SYS_ISDIR:                  /* Tests if a fd represents a directory. */
+    	syscall_isdir (f);
+    	break;
+    case SYS_INUMBER:                /* Returns the inode number for a fd. */
+    	syscall_inumber (f);
+    	break;
+#endif
   	default:
   	  thread_exit ();
   	  break;
@@ -114,10 +171,93 @@ check_user_vaddr_single (void *vaddr)
 
 	struct thread* t = thread_current ();
 	uint32_t *addr = pagedir_get_page (t->pagedir, vaddr);
+#ifdef VM
+	/* Pages are loaded lazily, so one that is not resident yet
+	   may still be valid. */
+	if (addr == NULL
+	    && (page_in (vaddr) || page_grow_stack (vaddr, t->user_esp)))
+		return;
+#endif
 	if (addr == NULL)
 		thread_exit ();
 }
 
+/* Most pages of kernel buffer that one read or write system
+   call passes its data through. */
+#define FILE_IO_PAGES 16
+
+/* Reads (or, if WRITE, writes) SIZE bytes between FILE and the
+   user BUFFER, and returns the number transferred, or -1 if no
+   kernel memory is available.  The data passes through a kernel
+   buffer, so that a page fault on BUFFER, which may have to read
+   a file itself or kill the process, never happens while the
+   file system holds a lock.
+
+   A transfer of up to FILE_IO_PAGES pages is made with a single
+   file_read() or file_write(), under a single hold of the
+   inode's lock, so that other readers and writers of the file
+   see all of it or none of it.  A larger one is split into
+   pieces of that size, each of which is atomic on its own. */
+static int
+file_io (struct file *file, void *buffer, int size, bool write)
+{
+	size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+	uint8_t *bounce;
+	int chunk_max;
+	int done = 0;
+
+	if (size <= 0)
+		return 0;
+	if (page_cnt > FILE_IO_PAGES)
+		page_cnt = FILE_IO_PAGES;
+	bounce = palloc_get_multiple (0, page_cnt);
+	if (bounce == NULL && page_cnt > 1)
+	{
+		page_cnt = 1;
+		bounce = palloc_get_page (0);
+	}
+	if (bounce == NULL)
+		return -1;
+	chunk_max = page_cnt * PGSIZE;
+
+	/* Copying to or from BUFFER kills the process if BUFFER is
+	   bad, and then process_exit() frees the bounce buffer. */
+	thread_current ()->io_buffer = bounce;
+	thread_current ()->io_page_cnt = page_cnt;
+
+	while (done < size)
+	{
+		int chunk = size - done < chunk_max ? size - done : chunk_max;
+		int result;
+
+		if (write)
+		{
+			memcpy (bounce, buffer + done, chunk);
+			result = file_write (file, bounce, chunk);
+		} else {
+			result = file_read (file, bounce, chunk);
+			memcpy (buffer + done, bounce, result);
+		}
+		done += result;
+		if (result < chunk)
+			break;
+	}
+	syscall_free_buffer ();
+	return done;
+}
+
+/* Frees the kernel buffer of the read or write system call that
+   the running thread is in the middle of, if any. */
+void
+syscall_free_buffer (void)
+{
+	struct thread *t = thread_current ();
+
+	palloc_free_multiple (t->io_buffer, t->io_page_cnt);
+	t->io_buffer = NULL;
+	t->io_page_cnt = 0;
+}
+
 static void
 syscall_halt ()
 {
@@ -133,7 +273,8 @@ syscall_exit (struct intr_frame *f UNUSED)
 
 	struct thread* t = thread_current ();
 
-	update_exit_status (t->tid, status);
+	if (t->proc != NULL)
+		process_info_set_exit_status (t->proc, status);
 	t->exit_status = status;
 
 	f->eax = status;		// return the status.
@@ -153,36 +294,23 @@ syscall_exec (struct intr_frame *f)
 
 	check_user_vaddr (cmd_line, 2);
 
-	tid_t child_tid = process_execute (cmd_line);
-	pid_t pid = get_pid (child_tid);
-	struct thread* t = thread_current ();
-	if (pid != -1)
-		t->pidmap = add_pid_map (t->pidmap, pid, child_tid);  // correlate the child_tid with pid(child)
-
-	f->eax = pid;
+	f->eax = process_execute (cmd_line);
 }
 
 static void
 syscall_wait (struct intr_frame *f)
 {
-	struct thread* t = thread_current ();
-	tid_t tid = -1;
-
 	pid_t* pid_addr = (pid_t *)(f->esp+4);
 	check_user_vaddr (pid_addr, sizeof(pid_t));
 	pid_t pid = *pid_addr;
 
-	if ((tid = get_tid_from_pidmap (t->pidmap, pid)) != TID_ERROR) 
-	{
-		int result = process_wait (tid);
-		remove_pid_map (t->pidmap, pid);
-		f->eax = result;
-	}
-	else //pid does not refer to a direct child of the calling process
-	{
-		f->eax = -1;
-	}
-	
+	f->eax = process_wait (pid);
+}
+
+static void
+syscall_fork (struct intr_frame *f)
+{
+	f->eax = process_fork (f);
 }
 
 static void
@@ -201,9 +329,7 @@ syscall_create (struct intr_frame *f)
 	check_user_vaddr (initial_size_, sizeof(unsigned));
 	unsigned initial_size = *initial_size_;
 
-	filesys_lock_acquire ();  // In process.c
 	bool success = filesys_create (file, initial_size);
-	filesys_lock_release ();
 
 	f->eax = success;
 }
@@ -220,9 +346,9 @@ syscall_remove (struct intr_frame *f)
 	/* Ignore other char after first one, Should add*/
 	check_user_vaddr (file, 1);
 
-	filesys_lock_acquire ();
-	filesys_remove (file);
-	filesys_lock_release ();
+	bool success = filesys_remove (file);
+
+	f->eax = success;
 }
 
 static void 
@@ -236,9 +362,7 @@ syscall_open (struct intr_frame *f)
 		thread_exit ();
 	check_user_vaddr (file_name, 1);
 
-	filesys_lock_acquire ();
 	struct file* file = filesys_open (file_name);
-	filesys_lock_release ();
 
 	if (file == NULL)
 	{
@@ -265,9 +389,7 @@ syscall_filesize (struct intr_frame *f)
 		thread_exit ();
 
 	int length = 0;
-	filesys_lock_acquire ();
 	length = file_length (file);
-	filesys_lock_release ();
 
 	f->eax = length;
 }
@@ -305,13 +427,15 @@ syscall_read (struct intr_frame *f)
 
 	} else {
 		struct file* file = fdmap_get (thread_current()->fdmap, fd);
+#ifdef FILESYS
+		if (file != NULL && is_dir_file (file))
+			file = NULL;
+#endif
 		if (file == NULL) 
 		{
 			f->eax = -1;
 		} else {
-			filesys_lock_acquire ();
-			int result = file_read (file, buffer, size);
-			filesys_lock_release ();
+			int result = file_io (file, buffer, size, false);
 			f->eax = result;
 		}
 	}
@@ -344,13 +468,15 @@ syscall_write (struct intr_frame *f)
 	} else {
 
 		struct file* file = fdmap_get (thread_current()->fdmap, fd);
+#ifdef FILESYS
+		if (file != NULL && is_dir_file (file))
+			file = NULL;
+#endif
 		if (file == NULL) 
 		{
 			f->eax = -1;
 		} else {
-			filesys_lock_acquire ();
-			int result = file_write (file, buffer, size);
-			filesys_lock_release ();
+			int result = file_io (file, buffer, size, true);
 			f->eax = result;
 		}
 	} 
@@ -374,9 +500,7 @@ syscall_seek (struct intr_frame *f)
 	{
 		thread_exit ();
 	} else {
-		filesys_lock_acquire ();
 		file_seek (file, position);
-		filesys_lock_release ();
 	}
 
 }
@@ -393,9 +517,7 @@ syscall_tell (struct intr_frame *f)
 	{
 		thread_exit ();
 	} else {
-		filesys_lock_acquire ();
 		int result = file_tell (file);
-		filesys_lock_release ();
 
 		f->eax = result;
 	}
@@ -411,3 +533,144 @@ syscall_close (struct intr_frame *f)
 	fdmap_remove (thread_current()->fdmap, fd);
 }
 
+#ifdef VM
+static void
+syscall_mmap (struct intr_frame *f)
+{
+	int *fd_addr = (int *)(f->esp+4);
+	check_user_vaddr (fd_addr, sizeof(int));
+	int fd = *fd_addr;
+
+	void **addr_ = (void **)(f->esp+8);
+	check_user_vaddr (addr_, sizeof (void*));
+	void *addr = *addr_;
+
+	struct file* file = fdmap_get (thread_current()->fdmap, fd);
+	if (file == NULL)
+	{
+		f->eax = MAP_FAILED;
+		return;
+	}
+
+	f->eax = mmap_map (file, addr);
+}
+
+static void
+syscall_munmap (struct intr_frame *f)
+{
+	mapid_t *mapid_addr = (mapid_t *)(f->esp+4);
+	check_user_vaddr (mapid_addr, sizeof(mapid_t));
+	mapid_t mapid = *mapid_addr;
+
+	mmap_unmap (mapid);
+}
+#endif
+
+#ifdef FILESYS
+static void
+syscall_chdir (struct intr_frame *f)
+{
+	char **dir_ = f->esp+4;
+	check_user_vaddr (dir_, sizeof(char *));
+	char *dir = *dir_;
+
+	if (dir == NULL)
+		thread_exit ();
+	check_user_vaddr (dir, 1);
+
+	bool success = filesys_chdir (dir);
+
+	f->eax = success;
+}
+
+static void
+syscall_mkdir (struct intr_frame *f)
+{
+	char **dir_ = f->esp+4;
+	check_user_vaddr (dir_, sizeof(char *));
+	char *dir = *dir_;
+
+	if (dir == NULL)
+		thread_exit ();
+	check_user_vaddr (dir, 1);
+
+	bool success = filesys_mkdir (dir);
+
+	f->eax = success;
+}
+
+/* Reads the next entry of the directory open as fd.  The file
+   position of a directory is the index of its next entry. */
+static void
+syscall_readdir (struct intr_frame *f)
+{
+	int *fd_addr = (int *)(f->esp+4);
+	check_user_vaddr (fd_addr, sizeof(int));
+	int fd = *fd_addr;
+
+	char **name_addr = (char **)(f->esp+8);
+	check_user_vaddr (name_addr, sizeof (char *));
+	char *name = *name_addr;
+
+	if (name == NULL)
+		thread_exit ();
+	check_user_vaddr (name, NAME_MAX + 1);
+
+	struct file* file = fdmap_get (thread_current()->fdmap, fd);
+	if (file == NULL || !is_dir_file (file))
+	{
+		f->eax = false;
+		return;
+	}
+
+	char entry[NAME_MAX + 1];
+	bool success = false;
+	struct dir *dir = dir_open (inode_reopen (file_get_inode (file)));
+	if (dir != NULL)
+	{
+		dir_seek (dir, file_tell (file));
+		success = dir_readdir (dir, entry);
+		file_seek (file, dir_tell (dir));
+		dir_close (dir);
+	}
+
+	if (success)
+		strlcpy (name, entry, NAME_MAX + 1);
+	f->eax = success;
+}
+
+static void
+syscall_isdir (struct intr_frame *f)
+{
+	int *fd_addr = (int *)(f->esp+4);
+	check_user_vaddr (fd_addr, sizeof(int));
+	int fd = *fd_addr;
+
+	struct file* file = fdmap_get (thread_current()->fdmap, fd);
+	if (file == NULL)
+		thread_exit ();
+
+	f->eax = is_dir_file (file);
+}
+
+static void
+syscall_inumber (struct intr_frame *f)
+{
+	int *fd_addr = (int *)(f->esp+4);
+	check_user_vaddr (fd_addr, sizeof(int));
+	int fd = *fd_addr;
+
+	struct file* file = fdmap_get (thread_current()->fdmap, fd);
+	if (file == NULL)
+		thread_exit ();
+
+	f->eax = inode_get_inumber (file_get_inode (file));
+}
+
+/* Returns true if FILE is open on a directory. */
+static bool
+is_dir_file (struct file *file)
+{
+	return inode_is_dir (file_get_inode (file));
+}
+#endif
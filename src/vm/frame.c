@@ -0,0 +1,352 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/imagecache.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+
+/* A process other than the first that maps a frame shared
+   after fork(). */
+struct frame_sharer
+  {
+    uint32_t *pagedir;                  /* Its page directory. */
+    struct page *page;                  /* Its page. */
+    struct frame_sharer *next;          /* Next sharer, or null. */
+  };
+
+/* Frame table, indexed by frame number. */
+static struct frame *frames;
+
+/* Frames that can be evicted, in clock order: the front of the
+   list is under the clock hand. */
+static struct list frame_list;
+
+/* Protects the frame table.  Held across eviction, including
+   its swap I/O, so that a process faulting on a page that is
+   being written out waits in frame_alloc() until it is safe to
+   read it back. */
+static struct lock frame_lock;
+
+/* Statistics. */
+static size_t frames_in_use;
+static size_t frames_peak;
+static long long frame_alloc_cnt;
+static long long evict_cnt;
+
+static struct frame *frame_of (void *kpage);
+static void *kpage_of (struct frame *);
+static void untrack (struct frame *);
+static void *evict (void);
+static bool test_accessed (struct frame *);
+static bool page_out_all (struct frame *);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  frames = calloc (init_ram_pages, sizeof *frames);
+  if (frames == NULL)
+    PANIC ("could not allocate frame table");
+  list_init (&frame_list);
+  lock_init (&frame_lock);
+}
+
+/* Obtains a frame for a user page and returns its kernel virtual
+   address, or a null pointer if no frame is available.  If the
+   user pool is exhausted, unused cached images are dropped
+   first, then a page of some process is evicted.  FLAGS are
+   passed on to palloc_get_page(); PAL_USER is implied.
+
+   The frame cannot be evicted until it is passed to
+   frame_claim(). */
+void *
+frame_alloc (enum palloc_flags flags)
+{
+  void *kpage;
+
+  lock_acquire (&frame_lock);
+  kpage = palloc_get_page (flags | PAL_USER);
+  while (kpage == NULL && imagecache_shrink ())
+    kpage = palloc_get_page (flags | PAL_USER);
+  if (kpage == NULL)
+    {
+      kpage = evict ();
+      if (kpage != NULL && (flags & PAL_ZERO))
+        memset (kpage, 0, PGSIZE);
+    }
+  if (kpage != NULL)
+    frame_alloc_cnt++;
+  lock_release (&frame_lock);
+  return kpage;
+}
+
+/* Makes KPAGE, now mapped at UPAGE in the current process's page
+   directory, the sole property of the current process and a
+   candidate for eviction.  KPAGE may already be tracked, if it
+   was shared after fork() and the current process is the last
+   to map it.  The caller may already hold the frame table
+   lock. */
+void
+frame_claim (void *kpage, void *upage)
+{
+  struct frame *f = frame_of (kpage);
+  struct page *p = page_find (upage);
+  bool locked = !lock_held_by_current_thread (&frame_lock);
+
+  ASSERT (p != NULL);
+
+  if (locked)
+    lock_acquire (&frame_lock);
+  if (f->page == NULL)
+    {
+      f->pagedir = thread_current ()->pagedir;
+      f->page = p;
+      list_push_back (&frame_list, &f->elem);
+      if (++frames_in_use > frames_peak)
+        frames_peak = frames_in_use;
+    }
+  else
+    ASSERT (f->page == p && f->sharers == NULL);
+  if (locked)
+    lock_release (&frame_lock);
+}
+
+/* Records that KPAGE, a frame of a forking process, is now also
+   mapped by the child, as page P in page directory PD, so that
+   eviction pages it out of both.  Frames that are not tracked
+   are left alone.  If memory runs out, KPAGE is untracked
+   instead and stays resident until it is no longer shared.  The
+   caller must hold the frame table lock. */
+void
+frame_share (void *kpage, uint32_t *pd, struct page *p)
+{
+  struct frame *f = frame_of (kpage);
+  struct frame_sharer *s;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (f->page == NULL)
+    return;
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    {
+      untrack (f);
+      return;
+    }
+  s->pagedir = pd;
+  s->page = p;
+  s->next = f->sharers;
+  f->sharers = s;
+}
+
+/* Records that page directory PD no longer maps KPAGE, a frame
+   that other processes still share.  The caller may already
+   hold the frame table lock. */
+void
+frame_unshare (void *kpage, uint32_t *pd)
+{
+  struct frame *f = frame_of (kpage);
+  bool locked = !lock_held_by_current_thread (&frame_lock);
+
+  if (locked)
+    lock_acquire (&frame_lock);
+  if (f->page != NULL)
+    {
+      struct frame_sharer **sp;
+
+      /* If PD is the first process, the next one takes its
+         place. */
+      if (f->pagedir == pd)
+        {
+          struct frame_sharer *s = f->sharers;
+          if (s != NULL)
+            {
+              f->pagedir = s->pagedir;
+              f->page = s->page;
+              f->sharers = s->next;
+              free (s);
+            }
+          else
+            untrack (f);
+        }
+      else
+        for (sp = &f->sharers; *sp != NULL; sp = &(*sp)->next)
+          if ((*sp)->pagedir == pd)
+            {
+              struct frame_sharer *s = *sp;
+              *sp = s->next;
+              free (s);
+              break;
+            }
+    }
+  if (locked)
+    lock_release (&frame_lock);
+}
+
+/* Frees KPAGE, a frame obtained from frame_alloc().  The caller
+   may already hold the frame table lock. */
+void
+frame_free (void *kpage)
+{
+  bool locked = !lock_held_by_current_thread (&frame_lock);
+
+  if (locked)
+    lock_acquire (&frame_lock);
+  untrack (frame_of (kpage));
+  if (locked)
+    lock_release (&frame_lock);
+  palloc_free_page (kpage);
+}
+
+/* Acquires the frame table lock, which keeps every frame where
+   it is until frame_lock_release(). */
+void
+frame_lock_acquire (void)
+{
+  lock_acquire (&frame_lock);
+}
+
+/* Releases the frame table lock. */
+void
+frame_lock_release (void)
+{
+  lock_release (&frame_lock);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %lld allocated, %zu in use, %zu peak, %lld evicted\n",
+          frame_alloc_cnt, frames_in_use, frames_peak, evict_cnt);
+}
+
+/* Returns the frame table entry for KPAGE. */
+static struct frame *
+frame_of (void *kpage)
+{
+  size_t idx = vtop (kpage) >> PGBITS;
+
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (idx < init_ram_pages);
+  return &frames[idx];
+}
+
+/* Returns the kernel virtual address of frame F. */
+static void *
+kpage_of (struct frame *f)
+{
+  return ptov ((uintptr_t) (f - frames) << PGBITS);
+}
+
+/* Takes frame F away from its owners, if it has any.
+   The caller must hold frame_lock. */
+static void
+untrack (struct frame *f)
+{
+  if (f->page != NULL)
+    {
+      while (f->sharers != NULL)
+        {
+          struct frame_sharer *s = f->sharers;
+          f->sharers = s->next;
+          free (s);
+        }
+      list_remove (&f->elem);
+      f->page = NULL;
+      f->pagedir = NULL;
+      frames_in_use--;
+    }
+}
+
+/* Chooses a victim with the clock algorithm, pages it out and
+   returns its frame, or a null pointer if no frame can be
+   evicted.  A page that was accessed since the hand last passed
+   it gets a second chance.  A frame shared after fork() is
+   paged out of every process that maps it.  The caller must
+   hold frame_lock. */
+static void *
+evict (void)
+{
+  size_t i;
+
+  /* Two sweeps clear every accessed bit, so if nothing is found
+     by then, nothing can be evicted. */
+  for (i = 0; i < 2 * frames_in_use; i++)
+    {
+      struct frame *f = list_entry (list_pop_front (&frame_list),
+                                    struct frame, elem);
+
+      /* Advance the hand past F. */
+      list_push_back (&frame_list, &f->elem);
+
+      if (!test_accessed (f) && page_out_all (f))
+        {
+          untrack (f);
+          evict_cnt++;
+          return kpage_of (f);
+        }
+    }
+  return NULL;
+}
+
+/* Returns true if any process that maps F accessed it since the
+   clock hand last passed, and clears the accessed bits. */
+static bool
+test_accessed (struct frame *f)
+{
+  struct frame_sharer *s;
+  bool accessed = pagedir_is_accessed (f->pagedir, f->page->upage);
+
+  pagedir_set_accessed (f->pagedir, f->page->upage, false);
+  for (s = f->sharers; s != NULL; s = s->next)
+    if (pagedir_is_accessed (s->pagedir, s->page->upage))
+      {
+        pagedir_set_accessed (s->pagedir, s->page->upage, false);
+        accessed = true;
+      }
+  return accessed;
+}
+
+/* Pages frame F out of every process that maps it.  Returns true
+   if successful.  If swap fills up part way, returns false, and
+   F stays mapped by the processes it was not yet paged out of. */
+static bool
+page_out_all (struct frame *f)
+{
+  void *kpage = kpage_of (f);
+  struct frame_sharer *s;
+
+  /* Shared pages are read-only, so only a write from before the
+     fork can have dirtied F, and only in the page directory that
+     made it.  Every process's copy must still be kept. */
+  if (f->sharers != NULL && f->page->writable)
+    {
+      bool dirty = pagedir_is_dirty (f->pagedir, f->page->upage);
+
+      for (s = f->sharers; s != NULL; s = s->next)
+        dirty = dirty || pagedir_is_dirty (s->pagedir, s->page->upage);
+      if (dirty)
+        {
+          pagedir_set_dirty (f->pagedir, f->page->upage, true);
+          for (s = f->sharers; s != NULL; s = s->next)
+            pagedir_set_dirty (s->pagedir, s->page->upage, true);
+        }
+    }
+
+  while ((s = f->sharers) != NULL)
+    {
+      if (!page_out (s->pagedir, s->page, kpage))
+        return false;
+      f->sharers = s->next;
+      free (s);
+      pagedir_unref_frame (kpage);
+    }
+  return page_out (f->pagedir, f->page, kpage);
+}
@@ -0,0 +1,40 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+
+struct page;
+struct frame_sharer;
+
+/* A physical frame holding a page of one or more user
+   processes.
+
+   There is one entry per physical page of memory, indexed by
+   frame number.  Tracked frames are candidates for eviction.
+   After fork(), a frame may be mapped by several processes: the
+   first is PAGEDIR and PAGE, the others are listed in SHARERS,
+   and eviction pages it out of all of them.  Frames of the image
+   cache, frames of 4 MB pages and frames still being filled are
+   not tracked and have a null PAGE. */
+struct frame
+  {
+    uint32_t *pagedir;                  /* Page directory mapping it. */
+    struct page *page;                  /* Page it holds. */
+    struct frame_sharer *sharers;       /* Other processes mapping it. */
+    struct list_elem elem;              /* Element in clock list. */
+  };
+
+void frame_init (void);
+void *frame_alloc (enum palloc_flags);
+void frame_claim (void *kpage, void *upage);
+void frame_share (void *kpage, uint32_t *pd, struct page *);
+void frame_unshare (void *kpage, uint32_t *pd);
+void frame_free (void *kpage);
+void frame_lock_acquire (void);
+void frame_lock_release (void);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,187 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* Statistics. */
+static long long map_cnt;
+static long long mapped_page_cnt;
+
+static struct mapping *mapping_lookup (mapid_t);
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process's address space starting
+   at user page ADDR.  Nothing is read until a page is touched,
+   and then straight into the page's frame.  The mapping keeps
+   its own handle on FILE, so closing FILE does not affect it.
+   Returns the new mapping's identifier, or MAP_FAILED if FILE is
+   empty, ADDR is not page-aligned or null, or the mapping would
+   overlap pages already in use. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t page_cnt, i;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || !is_user_vaddr (addr))
+    return MAP_FAILED;
+
+  length = file_length (file);
+  if (length == 0)
+    return MAP_FAILED;
+
+  /* The mapping must fit in user space below the stack and must
+     not overlap any page the process already has. */
+  page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (page_cnt > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr) / PGSIZE)
+    return MAP_FAILED;
+  for (i = 0; i < page_cnt; i++)
+    if (page_find ((uint8_t *) addr + i * PGSIZE) != NULL)
+      return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->id = t->next_mapid++;
+  m->addr = addr;
+  m->length = length;
+  m->page_cnt = 0;
+  list_push_back (&t->mappings, &m->elem);
+
+  /* PAGE_CNT counts the pages registered so far, so that unmap()
+     can undo a partial mapping. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      if (!page_add_mmap (m, i))
+        {
+          unmap (m);
+          return MAP_FAILED;
+        }
+      m->page_cnt++;
+    }
+
+  map_cnt++;
+  mapped_page_cnt += page_cnt;
+  return m->id;
+}
+
+/* Removes mapping MAPID of the current process, writing pages
+   that were modified back to the file.  Returns false if there
+   is no such mapping. */
+bool
+mmap_unmap (mapid_t mapid)
+{
+  struct mapping *m = mapping_lookup (mapid);
+
+  if (m == NULL)
+    return false;
+  unmap (m);
+  return true;
+}
+
+/* Removes every mapping of the current process, as on exit. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
+
+/* Gives the current process, a child being forked from PARENT,
+   its own copy of each of PARENT's mappings.  The child's
+   supplemental page table must already be a copy of PARENT's,
+   and PARENT must not run meanwhile.  Returns false if memory
+   runs out. */
+bool
+mmap_fork (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->mappings); e != list_end (&parent->mappings);
+       e = list_next (e))
+    {
+      struct mapping *pm = list_entry (e, struct mapping, elem);
+      struct mapping *m = malloc (sizeof *m);
+      size_t i;
+
+      if (m == NULL)
+        return false;
+      *m = *pm;
+      m->file = file_reopen (pm->file);
+      if (m->file == NULL)
+        {
+          free (m);
+          return false;
+        }
+      list_push_back (&t->mappings, &m->elem);
+
+      for (i = 0; i < m->page_cnt; i++)
+        {
+          struct page *p = page_find ((uint8_t *) m->addr + i * PGSIZE);
+          ASSERT (p != NULL && p->map == pm);
+          p->map = m;
+        }
+    }
+  t->next_mapid = parent->next_mapid;
+  return true;
+}
+
+/* Prints memory mapping statistics. */
+void
+mmap_print_stats (void)
+{
+  printf ("Mmap: %lld mappings, %lld pages mapped\n",
+          map_cnt, mapped_page_cnt);
+}
+
+/* Returns the current process's mapping with identifier MAPID,
+   or a null pointer if there is none. */
+static struct mapping *
+mapping_lookup (mapid_t mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes the pages of mapping M from the current process,
+   writing back the modified ones, and frees M. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  frame_lock_acquire ();
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove ((uint8_t *) m->addr + i * PGSIZE);
+  frame_lock_release ();
+  file_close (m->file);
+
+  list_remove (&m->elem);
+  free (m);
+}
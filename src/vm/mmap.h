@@ -0,0 +1,32 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct thread;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A file mapped into a process's address space. */
+struct mapping
+  {
+    mapid_t id;                         /* Identifier returned by mmap(). */
+    struct file *file;                  /* Own handle on the file. */
+    void *addr;                         /* First mapped user page. */
+    off_t length;                       /* File length when mapped. */
+    size_t page_cnt;                    /* Pages in the mapping. */
+    struct list_elem elem;              /* Element in process's list. */
+  };
+
+mapid_t mmap_map (struct file *, void *addr);
+bool mmap_unmap (mapid_t);
+void mmap_unmap_all (void);
+bool mmap_fork (struct thread *parent);
+void mmap_print_stats (void);
+
+#endif /* vm/mmap.h */
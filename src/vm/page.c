@@ -0,0 +1,581 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/imagecache.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/swap.h"
+
+/* Largest size of a user stack, in pages. */
+size_t stack_page_limit = 2048;
+
+/* Statistics. */
+static long long page_cnt;
+static long long zero_in_cnt;
+static long long file_in_cnt;
+static long long shared_in_cnt;
+static long long mmap_in_cnt;
+static long long mmap_out_cnt;
+static long long swap_in_cnt;
+static long long swap_out_cnt;
+static long long drop_cnt;
+static long long stack_grow_cnt;
+static long long large_in_cnt;
+
+static struct page *page_lookup (struct hash *, void *upage);
+static bool page_insert (struct hash *, struct page *);
+static size_t segment_read_bytes (struct image_segment *, size_t page_idx);
+static struct file *page_file (struct page *, off_t *ofs, size_t *bytes);
+static bool mmap_page_out (uint32_t *pd, struct page *, void *kpage);
+static bool page_in_large (struct page *);
+
+/* Hash function */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Hash function */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+
+  return a->upage < b->upage;
+}
+
+/* Use in hash_destroy
+   Free every element in page table, and its swap slot */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+  if (p->type == PAGE_SWAP && p->swap_slot != SWAP_SLOT_NONE)
+    swap_free (p->swap_slot);
+  free (p);
+}
+
+/* Creates an empty supplemental page table, or returns a null
+   pointer if memory allocation fails. */
+struct hash *
+page_table_create (void)
+{
+  struct hash *pages = malloc (sizeof *pages);
+  if (pages != NULL && !hash_init (pages, page_hash, page_less, NULL))
+    {
+      free (pages);
+      pages = NULL;
+    }
+  return pages;
+}
+
+/* Returns a copy of supplemental page table SRC for a forked
+   child whose page directory is PD, or a null pointer if memory
+   or swap runs out.  PD decides which of the pages are already
+   resident; the child is registered with their frames, so that
+   eviction pages them out of both processes.  Pages out on swap
+   are copied to new slots.  The caller must hold the frame table
+   lock, so that none of SRC's pages are evicted meanwhile. */
+struct hash *
+page_table_copy (struct hash *src, uint32_t *pd)
+{
+  struct hash *dst;
+  struct hash_iterator i;
+
+  if (src == NULL)
+    return NULL;
+  dst = page_table_create ();
+  if (dst == NULL)
+    return NULL;
+
+  hash_first (&i, src);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+      struct page *copy = malloc (sizeof *copy);
+      if (copy == NULL)
+        {
+          page_table_destroy (dst);
+          return NULL;
+        }
+      *copy = *p;
+      if (p->type == PAGE_SWAP && p->swap_slot != SWAP_SLOT_NONE)
+        {
+          copy->swap_slot = swap_dup (p->swap_slot);
+          if (copy->swap_slot == SWAP_SLOT_NONE)
+            {
+              free (copy);
+              page_table_destroy (dst);
+              return NULL;
+            }
+        }
+      hash_insert (dst, &copy->elem);
+    }
+
+  /* Only now that the copy cannot fail may the frames refer to
+     its pages. */
+  hash_first (&i, dst);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, elem);
+      void *kpage = pagedir_get_page (pd, p->upage);
+      if (kpage != NULL)
+        frame_share (kpage, pd, p);
+    }
+  return dst;
+}
+
+/* Frees supplemental page table PAGES.  The frames of resident
+   pages belong to the page directory and are freed with it. */
+void
+page_table_destroy (struct hash *pages)
+{
+  if (pages == NULL)
+    return;
+  hash_destroy (pages, page_free);
+  free (pages);
+}
+
+/* Registers every page of executable segment SEG with the
+   current process without reading any of it.  Pages that hold
+   nothing but zeros do not refer to the file at all.  Returns
+   true if successful, false if memory allocation fails or the
+   segment overlaps pages already registered. */
+bool
+page_add_segment (struct image_segment *seg)
+{
+  struct thread *t = thread_current ();
+  size_t page_cnt = (seg->read_bytes + seg->zero_bytes) / PGSIZE;
+  size_t page_idx;
+
+  ASSERT ((seg->read_bytes + seg->zero_bytes) % PGSIZE == 0);
+  ASSERT (pg_ofs (seg->upage) == 0);
+
+  for (page_idx = 0; page_idx < page_cnt; page_idx++)
+    {
+      struct page *p = malloc (sizeof *p);
+      if (p == NULL)
+        return false;
+      p->upage = seg->upage + page_idx * PGSIZE;
+      p->writable = seg->writable;
+      if (segment_read_bytes (seg, page_idx) > 0)
+        {
+          p->type = PAGE_FILE;
+          p->seg = seg;
+          p->page_idx = page_idx;
+        }
+      else
+        p->type = PAGE_ZERO;
+      p->swap_slot = SWAP_SLOT_NONE;
+      if (!page_insert (t->pages, p))
+        return false;
+    }
+  return true;
+}
+
+/* Registers a page of zeros at UPAGE with the current process.
+   Returns true if successful, false if memory allocation fails
+   or UPAGE is already registered. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = upage;
+  p->type = PAGE_ZERO;
+  p->writable = writable;
+  p->swap_slot = SWAP_SLOT_NONE;
+  return page_insert (thread_current ()->pages, p);
+}
+
+/* Registers page PAGE_IDX of mapping M with the current process.
+   Returns true if successful, false if memory allocation fails
+   or the page is already registered. */
+bool
+page_add_mmap (struct mapping *m, size_t page_idx)
+{
+  struct page *p = malloc (sizeof *p);
+  if (p == NULL)
+    return false;
+  p->upage = (uint8_t *) m->addr + page_idx * PGSIZE;
+  p->type = PAGE_MMAP;
+  p->writable = true;
+  p->map = m;
+  p->page_idx = page_idx;
+  p->swap_slot = SWAP_SLOT_NONE;
+  return page_insert (thread_current ()->pages, p);
+}
+
+/* Removes user page UPAGE from the current process.  A modified
+   page of a memory-mapped file is written back first.  The
+   caller must hold the frame table lock, so that the page is
+   not evicted meanwhile. */
+void
+page_remove (void *upage)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_find (upage);
+  void *kpage;
+
+  if (p == NULL)
+    return;
+
+  kpage = pagedir_get_page (t->pagedir, upage);
+  if (kpage != NULL)
+    {
+      if (p->type == PAGE_MMAP && pagedir_is_dirty (t->pagedir, upage))
+        {
+          off_t ofs;
+          size_t bytes;
+          struct file *file = page_file (p, &ofs, &bytes);
+          file_write_at (file, kpage, bytes, ofs);
+          mmap_out_cnt++;
+        }
+      pagedir_free_page (t->pagedir, upage);
+    }
+  else if (p->type == PAGE_SWAP && p->swap_slot != SWAP_SLOT_NONE)
+    swap_free (p->swap_slot);
+
+  hash_delete (t->pages, &p->elem);
+  free (p);
+}
+
+/* Brings the page containing user address UADDR into memory for
+   the current process, if it has registered that page.  Returns
+   true if the page is resident afterward, false if UADDR is not
+   part of the process's address space or no frame is
+   available. */
+bool
+page_in (void *uaddr)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  void *kpage = NULL;
+
+  if (t->pages == NULL || !is_user_vaddr (uaddr))
+    return false;
+  p = page_lookup (t->pages, pg_round_down (uaddr));
+  if (p == NULL)
+    return false;
+  if (pagedir_get_page (t->pagedir, p->upage) != NULL)
+    return true;
+
+  if (p->type == PAGE_ZERO)
+    {
+      if (page_in_large (p))
+        return true;
+      kpage = frame_alloc (PAL_ZERO);
+      if (kpage == NULL)
+        return false;
+      zero_in_cnt++;
+    }
+  else if (p->type == PAGE_SWAP)
+    {
+      /* If P is still being written out, frame_alloc() waits
+         for the write to finish. */
+      kpage = frame_alloc (0);
+      if (kpage == NULL)
+        return false;
+      swap_read (p->swap_slot, kpage);
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_SLOT_NONE;
+      swap_in_cnt++;
+    }
+  else
+    {
+      size_t read_bytes;
+      off_t ofs;
+      struct file *file = page_file (p, &ofs, &read_bytes);
+      bool shared = false;
+
+      /* Share the frame cached for a read-only page. */
+      if (p->type == PAGE_FILE && !p->writable)
+        kpage = imagecache_page (t->image, p->seg, p->page_idx, t->file);
+      if (kpage != NULL)
+        {
+          shared = pagedir_set_shared_page (t->pagedir, p->upage, kpage);
+          if (shared)
+            shared_in_cnt++;
+        }
+      else
+        {
+          kpage = frame_alloc (0);
+          if (kpage != NULL
+              && file_read_at (file, kpage, read_bytes, ofs)
+                 != (int) read_bytes)
+            {
+              frame_free (kpage);
+              kpage = NULL;
+            }
+          if (kpage != NULL)
+            {
+              memset ((uint8_t *) kpage + read_bytes, 0, PGSIZE - read_bytes);
+              if (p->type == PAGE_MMAP)
+                mmap_in_cnt++;
+              else
+                file_in_cnt++;
+            }
+        }
+
+      if (kpage == NULL)
+        return false;
+      if (shared)
+        return true;
+    }
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_free (kpage);
+      return false;
+    }
+  frame_claim (kpage, p->upage);
+  return true;
+}
+
+/* Grows the current process's stack down to user address UADDR
+   and brings in the page that holds it, if UADDR looks like a
+   stack access given user stack pointer ESP.  An access may be
+   up to 32 bytes below ESP, as by PUSHA, and the stack may not
+   exceed stack_page_limit pages.  Only the page that holds UADDR
+   is added; pages skipped over by a large stack frame are added
+   when they are touched.  Returns true if the page is resident
+   afterward. */
+bool
+page_grow_stack (void *uaddr, void *esp)
+{
+  uint8_t *stack_bottom = (uint8_t *) PHYS_BASE - stack_page_limit * PGSIZE;
+  void *upage = pg_round_down (uaddr);
+
+  if (thread_current ()->pages == NULL || !is_user_vaddr (uaddr)
+      || (uint8_t *) uaddr < stack_bottom
+      || (uint8_t *) uaddr + 32 < (uint8_t *) esp)
+    return false;
+  if (!page_add_zero (upage, true))
+    return false;
+  stack_grow_cnt++;
+  return page_in (upage);
+}
+
+/* Evicts page P, which is resident in frame KPAGE and mapped in
+   page directory PD.  A modified page of a memory-mapped file is
+   written back to the file, and any other page that may differ
+   from where it came from is written to swap.  The rest are
+   simply dropped and will be brought in again from their
+   source.  Returns true if successful, false if swap is full.
+   Called by the frame table with its lock held. */
+bool
+page_out (uint32_t *pd, struct page *p, void *kpage)
+{
+  size_t slot = SWAP_SLOT_NONE;
+  enum intr_level old_level;
+  bool dirty;
+
+  if (p->type == PAGE_MMAP)
+    return mmap_page_out (pd, p, kpage);
+
+  /* Only a writable page can differ from its source. */
+  if (p->writable)
+    {
+      slot = swap_alloc ();
+      if (slot == SWAP_SLOT_NONE)
+        return false;
+    }
+
+  /* Check the dirty bit and unmap the page in one step, so that
+     the owner cannot dirty the page in between, and record where
+     the page goes before the owner can fault on it. */
+  old_level = intr_disable ();
+  dirty = p->type == PAGE_SWAP || pagedir_is_dirty (pd, p->upage);
+  pagedir_clear_page (pd, p->upage);
+  if (dirty)
+    {
+      p->type = PAGE_SWAP;
+      p->swap_slot = slot;
+    }
+  intr_set_level (old_level);
+
+  if (dirty)
+    {
+      swap_write (slot, kpage);
+      swap_out_cnt++;
+    }
+  else
+    {
+      if (slot != SWAP_SLOT_NONE)
+        swap_free (slot);
+      drop_cnt++;
+    }
+  return true;
+}
+
+/* Evicts page P of a memory-mapped file, resident in KPAGE and
+   mapped in PD, writing it back if it was modified.  This may
+   wait for the file's inode lock, but whoever holds that never
+   waits for the frame table lock, because the file system does
+   not touch user memory. */
+static bool
+mmap_page_out (uint32_t *pd, struct page *p, void *kpage)
+{
+  enum intr_level old_level;
+  bool dirty;
+
+  old_level = intr_disable ();
+  dirty = pagedir_is_dirty (pd, p->upage);
+  pagedir_clear_page (pd, p->upage);
+  intr_set_level (old_level);
+
+  if (dirty)
+    {
+      off_t ofs;
+      size_t bytes;
+      struct file *file = page_file (p, &ofs, &bytes);
+      file_write_at (file, kpage, bytes, ofs);
+      mmap_out_cnt++;
+    }
+  else
+    drop_cnt++;
+  return true;
+}
+
+/* Returns the current process's entry for user page UPAGE, or a
+   null pointer if there is none. */
+struct page *
+page_find (void *upage)
+{
+  struct thread *t = thread_current ();
+  return t->pages != NULL ? page_lookup (t->pages, upage) : NULL;
+}
+
+/* Prints supplemental page table statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Paging: %lld pages registered, %lld zero-filled, "
+          "%lld read from file, %lld shared from image cache\n",
+          page_cnt, zero_in_cnt, file_in_cnt, shared_in_cnt);
+  printf ("Stack: %lld pages added by growth\n", stack_grow_cnt);
+  printf ("Large pages: %lld 4 MB zero regions mapped\n", large_in_cnt);
+  printf ("Mapped files: %lld pages read, %lld pages written back\n",
+          mmap_in_cnt, mmap_out_cnt);
+  printf ("Eviction: %lld pages swapped out, %lld swapped in, "
+          "%lld clean pages dropped\n",
+          swap_out_cnt, swap_in_cnt, drop_cnt);
+}
+
+/* Tries to satisfy a fault on P, a PAGE_ZERO page, by mapping
+   the whole 4 MB region around it with a single large page,
+   which saves 1023 further faults and the TLB entries to go
+   with them.  This works only if every page in the region is a
+   writable PAGE_ZERO page that is not mapped yet, as in a large
+   bss.  Large pages are never evicted, so they are only used
+   while memory is plentiful, and only if the CPU supports them,
+   since without CR4.PSE a large PDE would be taken for a page
+   table. */
+static bool
+page_in_large (struct page *p)
+{
+  struct thread *t = thread_current ();
+  uint8_t *base = (uint8_t *) ((uintptr_t) p->upage & ~(PTSPAN - 1));
+  void *kpage;
+  size_t i;
+
+  if (!large_pages || !p->writable
+      || !pagedir_is_region_empty (t->pagedir, base))
+    return false;
+  for (i = 0; i < PTSPAN / PGSIZE; i++)
+    {
+      struct page *q = page_lookup (t->pages, base + i * PGSIZE);
+      if (q == NULL || q->type != PAGE_ZERO || !q->writable)
+        return false;
+    }
+
+  kpage = palloc_get_large (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!pagedir_set_large_page (t->pagedir, base, kpage))
+    {
+      palloc_free_multiple (kpage, PTSPAN / PGSIZE);
+      return false;
+    }
+  large_in_cnt++;
+  return true;
+}
+
+/* Returns the entry for UPAGE in PAGES, or a null pointer if
+   there is none. */
+static struct page *
+page_lookup (struct hash *pages, void *upage)
+{
+  struct page key;
+  struct hash_elem *e;
+
+  key.upage = upage;
+  e = hash_find (pages, &key.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Inserts P into PAGES.  If PAGES already has an entry for the
+   same page, frees P and returns false. */
+static bool
+page_insert (struct hash *pages, struct page *p)
+{
+  if (hash_insert (pages, &p->elem) != NULL)
+    {
+      free (p);
+      return false;
+    }
+  page_cnt++;
+  return true;
+}
+
+/* Returns the number of bytes of page PAGE_IDX of SEG that come
+   from the file. */
+static size_t
+segment_read_bytes (struct image_segment *seg, size_t page_idx)
+{
+  uint32_t ofs = page_idx * PGSIZE;
+
+  if (seg->read_bytes <= ofs)
+    return 0;
+  return seg->read_bytes - ofs < PGSIZE ? seg->read_bytes - ofs : PGSIZE;
+}
+
+/* Returns the file that PAGE_FILE or PAGE_MMAP page P comes
+   from, and stores the offset of the page in the file in *OFS
+   and the number of bytes to transfer in *BYTES. */
+static struct file *
+page_file (struct page *p, off_t *ofs, size_t *bytes)
+{
+  if (p->type == PAGE_FILE)
+    {
+      *ofs = p->seg->file_page + p->page_idx * PGSIZE;
+      *bytes = segment_read_bytes (p->seg, p->page_idx);
+      return thread_current ()->file;
+    }
+  else
+    {
+      ASSERT (p->type == PAGE_MMAP);
+      *ofs = p->page_idx * PGSIZE;
+      *bytes = p->map->length - *ofs < PGSIZE ? p->map->length - *ofs : PGSIZE;
+      return p->map->file;
+    }
+}
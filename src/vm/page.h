@@ -0,0 +1,59 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest size of a user stack, in pages.  Set with -sl. */
+extern size_t stack_page_limit;
+
+struct image_segment;
+struct mapping;
+
+/* Where the contents of a page come from the first time it is
+   touched. */
+enum page_type
+  {
+    PAGE_ZERO,                          /* All zeros. */
+    PAGE_FILE,                          /* Executable segment. */
+    PAGE_SWAP,                          /* Swap slot, or only in memory. */
+    PAGE_MMAP                           /* Memory-mapped file. */
+  };
+
+/* Supplemental page table entry: everything needed to bring a
+   user page into memory.  Whether the page is resident is
+   recorded in the page directory only.
+
+   A page that was ever written and then evicted becomes
+   PAGE_SWAP for good.  While it is resident its SWAP_SLOT is
+   SWAP_SLOT_NONE, and it is written to a fresh slot each time it
+   is evicted.  A PAGE_MMAP page is written back to its file
+   instead. */
+struct page
+  {
+    void *upage;                        /* User virtual address. */
+    enum page_type type;                /* Source of contents. */
+    bool writable;                      /* Writable by the process? */
+    struct image_segment *seg;          /* PAGE_FILE: segment... */
+    struct mapping *map;                /* PAGE_MMAP: mapping... */
+    size_t page_idx;                    /* ...and page within it. */
+    size_t swap_slot;                   /* PAGE_SWAP: slot holding it. */
+    struct hash_elem elem;              /* Element in page table. */
+  };
+
+struct hash *page_table_create (void);
+struct hash *page_table_copy (struct hash *, uint32_t *pd);
+void page_table_destroy (struct hash *);
+bool page_add_segment (struct image_segment *);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (struct mapping *, size_t page_idx);
+void page_remove (void *upage);
+bool page_in (void *uaddr);
+bool page_grow_stack (void *uaddr, void *esp);
+bool page_out (uint32_t *pd, struct page *, void *kpage);
+struct page *page_find (void *upage);
+void page_print_stats (void);
+
+#endif /* vm/page.h */
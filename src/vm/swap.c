@@ -0,0 +1,120 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Sectors in one swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The swap device and its slots, one bit per slot, true if in
+   use.  Without a swap device there are no slots at all. */
+static struct block *swap_device;
+static struct bitmap *swap_slots;
+static struct lock swap_lock;
+
+/* Statistics. */
+static size_t slots_in_use;
+static size_t slots_peak;
+static long long swap_write_cnt;
+static long long swap_read_cnt;
+
+/* Sets up the swap slots on the block device in the swap role,
+   if there is one. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+  swap_slots = bitmap_create (slot_cnt);
+  if (swap_slots == NULL)
+    PANIC ("could not allocate swap slot bitmap");
+}
+
+/* Allocates a swap slot and returns it, or SWAP_SLOT_NONE if
+   swap is full. */
+size_t
+swap_alloc (void)
+{
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_slots, 0, 1, false);
+  if (slot != BITMAP_ERROR && ++slots_in_use > slots_peak)
+    slots_peak = slots_in_use;
+  lock_release (&swap_lock);
+  return slot != BITMAP_ERROR ? slot : SWAP_SLOT_NONE;
+}
+
+/* Allocates a new swap slot holding a copy of SLOT and returns
+   it, or SWAP_SLOT_NONE if swap is full or memory runs out. */
+size_t
+swap_dup (size_t slot)
+{
+  size_t copy;
+  void *buffer;
+
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return SWAP_SLOT_NONE;
+  copy = swap_alloc ();
+  if (copy != SWAP_SLOT_NONE)
+    {
+      swap_read (slot, buffer);
+      swap_write (copy, buffer);
+    }
+  palloc_free_page (buffer);
+  return copy;
+}
+
+/* Releases SLOT. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_slots, slot));
+  bitmap_reset (swap_slots, slot);
+  slots_in_use--;
+  lock_release (&swap_lock);
+}
+
+/* Writes the page at KPAGE to SLOT. */
+void
+swap_write (size_t slot, const void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_write (swap_device, slot * SECTORS_PER_SLOT + i,
+                 (const uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  swap_write_cnt++;
+}
+
+/* Reads SLOT into the page at KPAGE. */
+void
+swap_read (size_t slot, void *kpage)
+{
+  size_t i;
+
+  for (i = 0; i < SECTORS_PER_SLOT; i++)
+    block_read (swap_device, slot * SECTORS_PER_SLOT + i,
+                (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE);
+  swap_read_cnt++;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages written, %lld pages read, "
+          "%zu of %zu slots peak\n",
+          swap_write_cnt, swap_read_cnt, slots_peak,
+          bitmap_size (swap_slots));
+}
@@ -0,0 +1,18 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A page-sized slot on the swap device, or none. */
+#define SWAP_SLOT_NONE SIZE_MAX
+
+void swap_init (void);
+size_t swap_alloc (void);
+size_t swap_dup (size_t slot);
+void swap_free (size_t slot);
+void swap_write (size_t slot, const void *kpage);
+void swap_read (size_t slot, void *kpage);
+void swap_print_stats (void);
+
+#endif /* vm/swap.h */